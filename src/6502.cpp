@@ -9,6 +9,12 @@
 
 #include "6502_instr_timing.inl"
 
+// computed goto skips the destructors the instruction timers rely on
+#if INSTRUCTION_TIMING
+#undef THREADED_DISPATCH
+#define THREADED_DISPATCH 0
+#endif
+
 #if TRACE_DEBUG
 static unsigned int cpuBreakpoint = 0x10000;
 static unsigned int memWriteBreakpoint = 0x10000;
@@ -246,11 +252,103 @@ FORCE_INLINE void PLP() {
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // BRANCH / JUMP
 
+// clocks at the start of the current cpu6502_Step, no other device has run since
+static MACHINE_STATE uint64 stepStartClocks = 0;
+
+// whether a read from the given address can be repeated with no side effects (RAM, PPUSTATUS, WRAM and ROM)
+static bool isIdleReadAddress(unsigned int addr) {
+	return addr < 0x2000 || addr == 0x2002 || addr >= 0x6000;
+}
+
+// returns the clocks for a load at the given address that is safe to repeat, 0 for any other instruction
+static unsigned int idleLoadClocks(unsigned int addr, unsigned int& size) {
+	switch (mainCPU.readNonIO(addr)) {
+		case 0xA5: case 0xA6: case 0xA4: case 0x24:	// LDA, LDX, LDY, BIT zero page
+			size = 2;
+			return 3;
+		case 0xAD: case 0xAE: case 0xAC: case 0x2C:	// LDA, LDX, LDY, BIT absolute
+			size = 3;
+			return isIdleReadAddress(mainCPU.readNonIO(addr + 1) + (mainCPU.readNonIO(addr + 2) << 8)) ? 4 : 0;
+	}
+	return 0;
+}
+
+// returns the clocks for a test of the loaded value that is safe to repeat, 0 for any other instruction
+static unsigned int idleTestClocks(unsigned int addr, unsigned int& size) {
+	switch (mainCPU.readNonIO(addr)) {
+		case 0xC9: case 0xE0: case 0xC0: case 0x29:	// CMP, CPX, CPY, AND immediate
+			size = 2;
+			return 2;
+		case 0xC5: case 0xE4: case 0xC4:				// CMP, CPX, CPY zero page
+			size = 2;
+			return 3;
+		case 0xCD: case 0xEC: case 0xCC:				// CMP, CPX, CPY absolute
+			size = 3;
+			return isIdleReadAddress(mainCPU.readNonIO(addr + 1) + (mainCPU.readNonIO(addr + 2) << 8)) ? 4 : 0;
+	}
+	return 0;
+}
+
+// Wait loops (LDA $2002 / BPL, or LDA flag / BEQ waiting on the NMI handler) load the same values every iteration
+// until the next PPU, APU or IRQ event, so whole iterations up to that point can be skipped without changing the
+// outcome. Returns the clocks per iteration for a loop from loopStart back to the branch at branchAddr, 0 if not idle,
+// and the instructions per iteration in loopInstructions
+static NOINLINE unsigned int idleLoopClocks(unsigned int loopStart, unsigned int branchAddr, unsigned int branchClocks, unsigned int& loopInstructions) {
+	if (loopStart == branchAddr) {
+		// branch to itself, nothing can change until an interrupt
+		loopInstructions = 1;
+		return branchClocks;
+	}
+
+	if (loopStart >= 0x2000 && loopStart < 0x6000) {
+		return 0;
+	}
+
+	unsigned int loadSize = 0;
+	unsigned int clocks = idleLoadClocks(loopStart, loadSize);
+	if (clocks == 0) {
+		return 0;
+	}
+	if (loopStart + loadSize == branchAddr) {
+		loopInstructions = 2;
+		return clocks + branchClocks;
+	}
+
+	unsigned int testSize = 0;
+	unsigned int testClocks = idleTestClocks(loopStart + loadSize, testSize);
+	if (testClocks == 0 || loopStart + loadSize + testSize != branchAddr) {
+		return 0;
+	}
+
+	loopInstructions = 3;
+	return clocks + testClocks + branchClocks;
+}
+
 FORCE_INLINE void takeBranch(unsigned int data) {
 	unsigned int oldPC = mainCPU.PC;
 	mainCPU.PC += (char) (data);
 	mainCPU.clocks++;
 	if ((oldPC ^ mainCPU.PC) & 0x100) mainCPU.clocks++;
+
+	// short backwards branch over at most two instructions
+	if (oldPC - mainCPU.PC - 2 <= 6) {
+		unsigned int loopInstructions = 0;
+		unsigned int loopClocks = idleLoopClocks(mainCPU.PC, oldPC - 2, ((oldPC ^ mainCPU.PC) & 0x100) ? 4 : 3, loopInstructions);
+
+		// the iteration just completed must not straddle a device step, or its loads could be stale
+		if (loopClocks && mainCPU.clocks - stepStartClocks >= loopClocks) {
+			// stop with a full iteration remaining so the final reads and event timing play out normally
+			unsigned int remaining = (unsigned int) (mainCPU.nextClocks - mainCPU.clocks);
+			if (!mainCPU.reachedNextClocks() && remaining > loopClocks) {
+				const unsigned int iterations = (remaining - 1) / loopClocks;
+				mainCPU.clocks += iterations * loopClocks;
+#if COUNT_INSTRUCTIONS
+				// skipped iterations still count, so instruction rates compare with runs that don't skip
+				cpu6502_InstructionCount += iterations * loopInstructions;
+#endif
+			}
+		}
+	}
 }
 
 FORCE_INLINE void BPL(unsigned int data) {
@@ -305,7 +403,7 @@ FORCE_INLINE void JMP_MEM(unsigned int addr) {
 	// common infinite loop
 	if (mainCPU.PC == addr + 3) {
 		// skip ahead until next interrupt
-		for (; mainCPU.clocks < mainCPU.nextClocks;) {
+		for (; !mainCPU.reachedNextClocks();) {
 			mainCPU.clocks += 3;
 		}
 	}
@@ -719,105 +817,138 @@ unsigned int eff_address(unsigned int addr) { effAddr = addr; if (effAddr < 0x20
 #define eff_address(X) (X)
 #endif
 
-FORCE_INLINE void cpu6502_PerformInstruction() {
-#if TRACE_DEBUG
-	cpu_instr_history hist;
-	mainCPU.resolveToP();
-	memcpy(&hist.regs, &mainCPU, sizeof(cpu_6502));
-
-	effByte = 0;
-	hist.instr = mainCPU.readNonIO(mainCPU.PC+0);
-	hist.data1 = mainCPU.readNonIO(mainCPU.PC+1);
-	hist.data2 = mainCPU.readNonIO(mainCPU.PC+2);
+// instruction fetch, either from the predecoded record or directly from memory
+#if PREDECODE_INSTRUCTIONS
+#define FETCH_STATE() unsigned char instr; unsigned char data1; uint32 record;
+#define FETCH_INSTRUCTION() \
+	record = mainCPU.fetchInstruction(); \
+	instr = record & 0xFF; \
+	data1 = (record >> 8) & 0xFF; \
+	mainCPU.PC += 2;
+#define FETCH_OPERAND2() (mainCPU.PC++, (record >> 16) & 0xFF)
+#else
+#define FETCH_STATE() unsigned char instr; unsigned char data1;
+#define FETCH_INSTRUCTION() \
+	instr = mainCPU.readNonIO(mainCPU.PC++); \
+	data1 = mainCPU.readNonIO(mainCPU.PC++);
+#define FETCH_OPERAND2() mainCPU.readNonIO(mainCPU.PC++)
 #endif
 
-
-	unsigned char instr = mainCPU.readNonIO(mainCPU.PC++);
-	unsigned char data1 = mainCPU.readNonIO(mainCPU.PC++);
-
-	// all instructions at least 2 clks
-	mainCPU.clocks += 2;
-
-#define SKIP_LATCHING() goto SkipLatching;
-#define OPCODE_START(op,clk,sz) case op: { INSTR_TIMING(op); mainCPU.clocks += (clk-2);
-#define OPCODE_END(spc) spc break; }
-
-#define OPCODE_NON(op,str,clk,sz,page,name,spc) \
+// opcode bodies by addressing mode, expanded through the generic OPCODE() table macro. The dispatch method in use
+// supplies OPCODE_START, OPCODE_END and SKIP_LATCHING (used by instructions that can't touch a latched register)
+#define OPCODE_BODY_NON(op,str,clk,sz,page,name,spc) \
 	OPCODE_START(op,clk,sz) \
 		mainCPU.PC--; \
 		name(); \
 		SKIP_LATCHING(); \
 	OPCODE_END(spc) 
 
-#define OPCODE_IMM(op,str,clk,sz,page,name,spc) \
+#define OPCODE_BODY_IMM(op,str,clk,sz,page,name,spc) \
 	OPCODE_START(op,clk,sz) \
 		name(data1); \
 		SKIP_LATCHING(); \
 	OPCODE_END(spc) 
 
-#define OPCODE_REL(op,str,clk,sz,page,name,spc) \
+#define OPCODE_BODY_REL(op,str,clk,sz,page,name,spc) \
 	OPCODE_START(op,clk,sz) \
 		name(data1); \
 		SKIP_LATCHING(); \
 	OPCODE_END(spc) 
 
-#define OPCODE_ABS(op,str,clk,sz,page,name,spc) \
+#define OPCODE_BODY_ABS(op,str,clk,sz,page,name,spc) \
 	OPCODE_START(op,clk,sz) \
-		unsigned int data2 = mainCPU.readNonIO(mainCPU.PC++); \
+		unsigned int data2 = FETCH_OPERAND2(); \
 		name##_MEM(eff_address(data1 + (data2 << 8))); \
 	OPCODE_END(spc) 
 
-#define OPCODE_ABX(op,str,clk,sz,page,name,spc) \
+#define OPCODE_BODY_ABX(op,str,clk,sz,page,name,spc) \
 	OPCODE_START(op,clk,sz) \
-		unsigned int data2 = mainCPU.readNonIO(mainCPU.PC++); \
+		unsigned int data2 = FETCH_OPERAND2(); \
 		if (page && ((data1 + mainCPU.X) & 0x100)) mainCPU.clocks++; \
 		name##_MEM(eff_address(data1 + (data2 << 8) + (mainCPU.X))); \
 	OPCODE_END(spc) 
 
-#define OPCODE_ABY(op,str,clk,sz,page,name,spc) \
+#define OPCODE_BODY_ABY(op,str,clk,sz,page,name,spc) \
 	OPCODE_START(op,clk,sz) \
-		unsigned int data2 = mainCPU.readNonIO(mainCPU.PC++); \
+		unsigned int data2 = FETCH_OPERAND2(); \
 		if (page && ((data1 + mainCPU.Y) & 0x100)) mainCPU.clocks++;	\
 		name##_MEM(eff_address(data1 + (data2 << 8) + (mainCPU.Y))); \
 	OPCODE_END(spc) 
 
-#define OPCODE_IND(op,str,clk,sz,page,name,spc) \
+#define OPCODE_BODY_IND(op,str,clk,sz,page,name,spc) \
 	OPCODE_START(op,clk,sz) \
-		unsigned int data2 = mainCPU.readNonIO(mainCPU.PC++); \
+		unsigned int data2 = FETCH_OPERAND2(); \
 		unsigned int target = (data2 << 8); \
 		name##_MEM(eff_address(mainCPU.readNonIO(data1 + target) + (mainCPU.readNonIO(((data1 + 1) & 0xFF) + target) << 8))); \
 	OPCODE_END(spc)
 
-#define OPCODE_INX(op,str,clk,sz,page,name,spc) \
+#define OPCODE_BODY_INX(op,str,clk,sz,page,name,spc) \
 	OPCODE_START(op,clk,sz) \
 		int target = (data1 + mainCPU.X) & 0xFF; \
 		name##_MEM(eff_address(CPU_RAM(target) + (CPU_RAM((target + 1) & 0xFF) << 8))); \
 	OPCODE_END(spc)
 
-#define OPCODE_INY(op,str,clk,sz,page,name,spc) \
+#define OPCODE_BODY_INY(op,str,clk,sz,page,name,spc) \
 	OPCODE_START(op,clk,sz) \
 		if (page && ((CPU_RAM(data1) + mainCPU.Y) & 0x100)) mainCPU.clocks++; \
 		name##_MEM(eff_address(CPU_RAM(data1) + (CPU_RAM((data1 + 1) & 0xFF) << 8) + mainCPU.Y)); \
 	OPCODE_END(spc) 
 
-#define OPCODE_ZRO(op,str,clk,sz,page,name,spc) \
+#define OPCODE_BODY_ZRO(op,str,clk,sz,page,name,spc) \
 	OPCODE_START(op,clk,sz) \
 		name##_ZERO(eff_address(data1)); \
 		SKIP_LATCHING(); \
 	OPCODE_END(spc)
 
-#define OPCODE_ZRX(op,str,clk,sz,page,name,spc) \
+#define OPCODE_BODY_ZRX(op,str,clk,sz,page,name,spc) \
 	OPCODE_START(op,clk,sz) \
 		name##_ZERO(eff_address((data1 + mainCPU.X) & 0xFF)); \
 		SKIP_LATCHING(); \
 	OPCODE_END(spc) 
 
-#define OPCODE_ZRY(op,str,clk,sz,page,name,spc) \
+#define OPCODE_BODY_ZRY(op,str,clk,sz,page,name,spc) \
 	OPCODE_START(op,clk,sz) \
 		name##_ZERO(eff_address((data1 + mainCPU.Y) & 0xFF)); \
 		SKIP_LATCHING(); \
 	OPCODE_END(spc)
 
+#define OPCODE_BY_MODE(mode,op,str,clk,sz,page,name,spc) OPCODE_BODY_##mode(op,str,clk,sz,page,name,spc)
+
+// handles any register access that was deferred until the instruction completed
+FORCE_INLINE void cpu6502_LatchRegisters() {
+	if (mainCPU.accessTable[0x2000 >> 13]) {
+		nesPPU.latchedReg(mainCPU.accessTable[0x2000 >> 13]);
+		mainCPU.accessTable[0x2000 >> 13] = 0;
+	} else if (mainCPU.accessTable[0x4000 >> 13]) {
+		mainCPU.latchedSpecial(mainCPU.accessTable[0x4000 >> 13]);
+		mainCPU.accessTable[0x4000 >> 13] = 0;
+	}
+}
+
+FORCE_INLINE void cpu6502_PerformInstruction() {
+#if TRACE_DEBUG
+	cpu_instr_history hist;
+	mainCPU.resolveToP();
+	memcpy(&hist.regs, &mainCPU, sizeof(cpu_6502));
+
+	effByte = 0;
+	hist.instr = mainCPU.readNonIO(mainCPU.PC+0);
+	hist.data1 = mainCPU.readNonIO(mainCPU.PC+1);
+	hist.data2 = mainCPU.readNonIO(mainCPU.PC+2);
+#endif
+
+
+	FETCH_STATE();
+	FETCH_INSTRUCTION();
+
+	// all instructions at least 2 clks
+	mainCPU.clocks += 2;
+
+#define SKIP_LATCHING() goto SkipLatching;
+#define OPCODE_START(op,clk,sz) case op: { INSTR_TIMING(op); mainCPU.clocks += (clk-2);
+#define OPCODE_END(spc) spc break; }
+#define OPCODE OPCODE_BY_MODE
+
 	switch (instr) {
 		#include "6502_opcodes.inl"
 		default:
@@ -830,13 +961,11 @@ FORCE_INLINE void cpu6502_PerformInstruction() {
 		}
 	};
 
-	if (mainCPU.accessTable[0x2000 >> 13]) {
-		nesPPU.latchedReg(mainCPU.accessTable[0x2000 >> 13]);
-		mainCPU.accessTable[0x2000 >> 13] = 0;
-	} else if (mainCPU.accessTable[0x4000 >> 13]) {
-		mainCPU.latchedSpecial(mainCPU.accessTable[0x4000 >> 13]);
-		mainCPU.accessTable[0x4000 >> 13] = 0;
-	}
+#undef SKIP_LATCHING
+#undef OPCODE_START
+#undef OPCODE_END
+
+	cpu6502_LatchRegisters();
 
 SkipLatching:
 
@@ -882,29 +1011,88 @@ SkipLatching:
 #endif
 }
 
+#if THREADED_DISPATCH
+// Runs instructions until nextClocks is reached using a computed goto label table built from the same opcode table.
+// The next opcode fetch and dispatch is repeated at the end of every handler so each gets its own indirect branch
+// (instead of the shared switch jump and its range check)
+static NOINLINE void cpu6502_RunThreaded() {
+	static MACHINE_STATE void* dispatchTable[256] = { nullptr };
+	if (dispatchTable[0] == nullptr) {
+		for (int i = 0; i < 256; i++) {
+			dispatchTable[i] = &&op_Illegal;
+		}
+#define OPCODE(mode,op,str,clk,sz,page,name,spc) dispatchTable[op] = &&op_##op;
+#include "6502_opcodes.inl"
+	}
+
+	FETCH_STATE();
+
+#define FETCH_AND_DISPATCH() \
+	FETCH_INSTRUCTION(); \
+	mainCPU.clocks += 2; \
+	goto *dispatchTable[instr];
+
+#if COUNT_INSTRUCTIONS
+#define COUNT_INSTRUCTION() cpu6502_InstructionCount++;
+#else
+#define COUNT_INSTRUCTION()
+#endif
+
+#define SKIP_LATCHING() \
+	DebugAssert(mainCPU.carryResult == 0 || mainCPU.carryResult == 1); \
+	COUNT_INSTRUCTION(); \
+	if (mainCPU.reachedNextClocks()) return; \
+	FETCH_AND_DISPATCH();
+#define OPCODE_START(op,clk,sz) op_##op: { mainCPU.clocks += (clk-2);
+#define OPCODE_END(spc) spc cpu6502_LatchRegisters(); SKIP_LATCHING(); }
+#define OPCODE OPCODE_BY_MODE
+
+	if (mainCPU.reachedNextClocks()) return;
+	FETCH_AND_DISPATCH();
+
+	#include "6502_opcodes.inl"
+
+op_Illegal:
+	DebugAssert(false);
+	cpu6502_LatchRegisters();
+	SKIP_LATCHING();
+
+#undef FETCH_AND_DISPATCH
+#undef COUNT_INSTRUCTION
+#undef SKIP_LATCHING
+#undef OPCODE_START
+#undef OPCODE_END
+}
+#endif
+
+#if COUNT_INSTRUCTIONS
+MACHINE_STATE unsigned int cpu6502_InstructionCount = 0;
+#endif
+
 void cpu6502_Step() {
 	TIME_SCOPE();
 
-	// stop at next PPU or IRQ
-	mainCPU.nextClocks = mainCPU.ppuClocks;
-
-	// only consider IRQ if the cpu is enabling interrupts
-	if (mainCPU.irqMask && (mainCPU.P & ST_INT) == 0) {
-		if ((mainCPU.irqMask & 0x01) && mainCPU.irqClock[0] < mainCPU.nextClocks) mainCPU.nextClocks = mainCPU.irqClock[0];
-		if ((mainCPU.irqMask & 0x02) && mainCPU.irqClock[1] < mainCPU.nextClocks) mainCPU.nextClocks = mainCPU.irqClock[1];
-		if ((mainCPU.irqMask & 0x04) && mainCPU.irqClock[2] < mainCPU.nextClocks) mainCPU.nextClocks = mainCPU.irqClock[2];
-		if ((mainCPU.irqMask & 0x08) && mainCPU.irqClock[3] < mainCPU.nextClocks) mainCPU.nextClocks = mainCPU.irqClock[3];
-	}
-	if (mainCPU.apuClocks < mainCPU.nextClocks) {
-		mainCPU.nextClocks = mainCPU.apuClocks;
+	// stop at next event (only consider IRQ if the cpu is enabling interrupts)
+	mainCPU.nextClocks = mainCPU.events.deadline((mainCPU.P & ST_INT) == 0);
+	if (mainCPU.nextClocks < mainCPU.clocks) {
+		mainCPU.nextClocks = mainCPU.clocks;
 	}
 	if (mainCPU.ppuNMI && mainCPU.nextClocks > mainCPU.clocks + 7) {
 		mainCPU.nextClocks = mainCPU.clocks + 7;
 	}
 
-	for (; mainCPU.clocks < mainCPU.nextClocks;) {
+	stepStartClocks = mainCPU.clocks;
+
+#if THREADED_DISPATCH
+	cpu6502_RunThreaded();
+#else
+	for (; !mainCPU.reachedNextClocks();) {
 		cpu6502_PerformInstruction();
+#if COUNT_INSTRUCTIONS
+		cpu6502_InstructionCount++;
+#endif
 	}
+#endif
 
 	if (mainCPU.ppuNMI) {
 		mainCPU.NMI();
@@ -956,7 +1144,7 @@ void cpu_instr_history::output() {
 
 	static bool showClocks = false;
 	if (showClocks) {
-		ADD_LOG("c%-11d ", regs.clocks);
+		ADD_LOG("c%-11llu ", regs.clocks);
 	}
 	static bool showRegs = true;
 	if (showRegs) {
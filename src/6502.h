@@ -18,6 +18,60 @@ enum ADDR_MODE {
 	AM_ZeroY,		// zero page + Y with no page translation 
 };
 
+// timed events, handled in this order when several are due on the same step
+enum CPU_EVENT {
+	CPU_EVENT_PPU,			// next PPU scanline step
+	CPU_EVENT_APU,			// next APU frame counter step
+	CPU_EVENT_IRQ,			// IRQ slots 0-3 (only considered while interrupts are enabled)
+	CPU_EVENT_COUNT = CPU_EVENT_IRQ + 4
+};
+
+// fixed capacity event queue kept sorted by clock, so the next deadline is always the first entry
+struct cpu_event_queue {
+	uint64 clocks[CPU_EVENT_COUNT];				// scheduled clock by event
+	unsigned char order[CPU_EVENT_COUNT];		// scheduled events sorted by clock
+	unsigned int count;
+
+	void clear() {
+		count = 0;
+	}
+
+	// removes the event from the queue if it is scheduled
+	void cancel(unsigned int event) {
+		for (unsigned int i = 0; i < count; i++) {
+			if (order[i] == event) {
+				count--;
+				for (; i < count; i++) {
+					order[i] = order[i + 1];
+				}
+				return;
+			}
+		}
+	}
+
+	// schedules (or reschedules) the event at the given clock
+	void schedule(unsigned int event, uint64 atClock) {
+		cancel(event);
+		clocks[event] = atClock;
+
+		unsigned int i = count++;
+		for (; i > 0 && clocks[order[i - 1]] > atClock; i--) {
+			order[i] = order[i - 1];
+		}
+		order[i] = event;
+	}
+
+	// clock of the first event, skipping IRQs if they are masked
+	uint64 deadline(bool bIncludeIRQ) const {
+		for (unsigned int i = 0; i < count; i++) {
+			if (bIncludeIRQ || order[i] < CPU_EVENT_IRQ) {
+				return clocks[order[i]];
+			}
+		}
+		return ~0ull;
+	}
+};
+
 struct cpu_6502 {
 	// main registers (stored as ints due to improved 32-bit speed, but only use the relevant bits)
 	unsigned int PC;	// program counter, 16-bit
@@ -32,29 +86,40 @@ struct cpu_6502 {
 	unsigned int zeroResult;			// Z if 0
 	unsigned int negativeResult;		// N if ST_NEG is set
 
-	// clock cycle counter
-	unsigned int clocks;
+	// clock cycle counter, the master clock every device timestamp is based on (64 bit so it never wraps)
+	uint64 clocks;
 
 	// next time instructions check for interrupts, PPU step, etc
-	unsigned int nextClocks;
+	uint64 nextClocks;
 
 	// represents a low IRQ latch if any are non 0 and our CPU clocks are past a given counter (for speed), up to 4 supported
 	unsigned int irqMask;
-	unsigned int irqClock[4];
+	uint64 irqClock[4];
+
+	// every timed device and pending IRQ, used to find the next time the CPU needs to stop
+	cpu_event_queue events;
 
 	// set the irq for the given irq number (clocks = 0 to immediately trigger)
-	void setIRQ(int irqNum, unsigned int clocks) {
+	void setIRQ(int irqNum, uint64 clocks) {
 		// don't set clocks forward if already acknowledged
 		if ((irqMask & (1 << irqNum)) && clocks > irqClock[irqNum])
 			clocks = irqClock[irqNum];
 
 		irqMask |= (1 << irqNum);
 		irqClock[irqNum] = clocks;
+		events.schedule(CPU_EVENT_IRQ + irqNum, clocks);
 	}
 
 	// acknowledge the given irq number
 	void ackIRQ(int irqNum) {
 		irqMask &= ~(1 << irqNum);
+		events.cancel(CPU_EVENT_IRQ + irqNum);
+	}
+
+	// whether clocks has reached nextClocks. cpu6502_Step keeps nextClocks at most a frame ahead of clocks, so
+	// comparing the low 32 bit difference is exact and keeps the instruction loop check as cheap as before
+	FORCE_INLINE bool reachedNextClocks() const {
+		return (int32) ((uint32) clocks - (uint32) nextClocks) >= 0;
 	}
 
 	// resolve the cached results to P
@@ -110,10 +175,15 @@ void cpu6502_DeviceInterrupt(unsigned int vectorAddress, bool masked);
 // runs software interrupt routine at the given vector address (if interrupt disable flag is 0)
 void cpu6502_SoftwareInterrupt(unsigned int vectorAddress);
 
+// caches decoded opcode and operand bytes per cached PRG bank (costs 32 KB per bank, so off where memory is tight)
+#ifndef PREDECODE_INSTRUCTIONS
+#define PREDECODE_INSTRUCTIONS TARGET_HOST
+#endif
+
 #if NES
 #include "nes.h"
 #include "nes_cpu.h"
-extern nes_cpu mainCPU ALIGN(256);
+extern MACHINE_STATE nes_cpu mainCPU ALIGN(256);
 #endif
 
 #define CPU_RAM(X) mainCPU.RAM[X]
@@ -122,4 +192,22 @@ extern nes_cpu mainCPU ALIGN(256);
 #define TRACE_DEBUG 1
 #else
 #define TRACE_DEBUG 0
+#endif
+
+// dispatches opcodes through a computed goto label table instead of a switch (requires GCC)
+#ifndef THREADED_DISPATCH
+#if defined(__GNUC__) && !TRACE_DEBUG
+#define THREADED_DISPATCH 1
+#else
+#define THREADED_DISPATCH 0
+#endif
+#endif
+
+// counts every executed instruction (used for host benchmarking)
+#ifndef COUNT_INSTRUCTIONS
+#define COUNT_INSTRUCTIONS TARGET_HOST
+#endif
+
+#if COUNT_INSTRUCTIONS
+extern MACHINE_STATE unsigned int cpu6502_InstructionCount;
 #endif
\ No newline at end of file
@@ -1,7 +1,9 @@
 #include "platform.h"
 #include "debug.h"
 
+#if !TARGET_HOST
 #include "calctype/fonts/arial_small/arial_small.h"
+#endif
 
 #if DEBUG_MEMWRITE
 unsigned short debugWriteAddress = 0;
@@ -16,6 +18,14 @@ void reset_printf() {
 	printY = 0;
 }
 
+#if TARGET_HOST
+// no screen on host, print output goes to stdout
+void ScreenPrint(char* buffer) {
+	size_t len = strlen(buffer);
+	fputs(buffer, stdout);
+	if (len == 0 || buffer[len - 1] != '\n') fputc('\n', stdout);
+}
+#else
 void ScreenPrint(char* buffer) {
 	int x = 5;
 	bool newline = buffer[strlen(buffer) - 1] == '\n';
@@ -23,6 +33,7 @@ void ScreenPrint(char* buffer) {
 	CalcType_Draw(&arial_small, buffer, x, printY + 2, COLOR_WHITE, 0, 0);
 	printY = (printY + arial_small.height) % 224;
 }
+#endif
 
 #if DEBUG
 #define BORDER "<><><><><><><><><><><><><><><><><><><><>\n"
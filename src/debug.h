@@ -2,7 +2,7 @@
 
 #if DEBUG
 
-#include "scope_timer\scope_timer.h"
+#include "scope_timer/scope_timer.h"
 
 #if TARGET_WINSIM
 #include <Windows.h>
@@ -43,6 +43,14 @@ extern InstructionsHistory instr_hist[DEBUG_TRACKINSTRUCTIONS];
 
 #define OutputLog(...) { char buffer[1024]; sprintf_s(buffer, 1024, __VA_ARGS__); OutputDebugString(buffer); }
 
+#elif TARGET_HOST
+
+void failedAssert(const char* assertion);
+#define DebugAssert(x) { if (!(x)) failedAssert(#x); }
+
+// host builds log straight to stderr
+#define OutputLog(...) { fprintf(stderr, __VA_ARGS__); }
+
 #else
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
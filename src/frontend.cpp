@@ -23,7 +23,7 @@ Menu Layout
 
 const bool bRebuildGfx = false;
 
-bool shouldExit = false;
+MACHINE_STATE bool shouldExit = false;
 
 struct foundFile {
 	char path[48];
@@ -124,6 +124,7 @@ foundFile* discoverFiles(int& numFound) {
 	if (!lastFound) {
 		numFound = 0;
 		FindFiles("\\\\fls0\\*.nes", files, numFound, 64);
+		FindFiles("\\\\fls0\\*.nz7", files, numFound, 64);
 		lastFound = numFound;
 	}
 
@@ -807,16 +808,7 @@ void nes_frontend::Run() {
 void nes_frontend::RunGameLoop() {
 	while (!shouldExit) {
 		cpu6502_Step();
-		if (mainCPU.clocks >= mainCPU.ppuClocks) nesPPU.step();
-		if (mainCPU.clocks >= mainCPU.apuClocks) nesAPU.step();
-
-		// both APU and PPU can trigger an immediate IRQ
-		if (mainCPU.irqMask) {
-			if ((mainCPU.irqMask & 1) && mainCPU.clocks >= mainCPU.irqClock[0]) cpu6502_IRQ(0);
-			else if ((mainCPU.irqMask & 2) && mainCPU.clocks >= mainCPU.irqClock[1]) cpu6502_IRQ(1);
-			else if ((mainCPU.irqMask & 4) && mainCPU.clocks >= mainCPU.irqClock[2]) cpu6502_IRQ(2);
-			else if ((mainCPU.irqMask & 8) && mainCPU.clocks >= mainCPU.irqClock[3]) cpu6502_IRQ(3);
-		}
+		mainCPU.dispatchEvents();
 	}
 
 	nesCart.OnPause();
@@ -881,5 +873,8 @@ MenuOption remapOptions[] =
 	{ "P2 Down", "", false, Option_RemapKey, Option_GetKeyDetails, NES_P2_DOWN},
 	{ "P2 Left", "", false, Option_RemapKey, Option_GetKeyDetails, NES_P2_LEFT},
 	{ "P2 Right", "", false, Option_RemapKey, Option_GetKeyDetails, NES_P2_RIGHT},
+	{ "Rewind", "", false, Option_RemapKey, Option_GetKeyDetails, NES_REWIND},
+	{ "Record Movie", "", false, Option_RemapKey, Option_GetKeyDetails, NES_MOVIE_RECORD},
+	{ "Play Movie", "", false, Option_RemapKey, Option_GetKeyDetails, NES_MOVIE_PLAY},
 	{ "Back", "Return to controls options", false, OptionMenu, nullptr, (int)SG_Controls },
 };
@@ -0,0 +1,315 @@
+// nesizm-bench : deterministic throughput benchmark over a directory of ROMs
+//
+// Each ROM runs for a fixed number of frames with scripted input. Frame rate and CPU instruction rate are
+// reported per ROM and per mapper, and each frame's VRAM and mixed audio are hashed and compared against
+// a baseline file so that speed work can't silently change output. With -runahead the frames shown come from
+// ahead of the machine, so only audio is compared and the time spent running ahead is reported. -record writes each
+// ROM's scripted input to a movie beside it (.nzm), and -movies plays those back in place of the script.
+
+#if TARGET_HOST
+
+#include "platform.h"
+#include "debug.h"
+#include "nes.h"
+#include "settings.h"
+#include "snd/snd.h"
+#include "host_runner.h"
+#include "host_simd.h"
+#include "host_bench.h"
+
+#include <dirent.h>
+
+struct bench_result {
+	char rom[64];
+	int32 mapper;
+	bool loaded;
+	bool noMovie;				// -movies, but the ROM has no movie that plays
+	double seconds;
+	uint32 instructions;
+	int32 mismatchFrame;		// first frame that differs from the baseline, -1 if none
+	bool hasBaseline;
+	nes_bank_stats bankStats;	// bank cache totals over the run (all zero when ROMs are memory mapped)
+	uint32 peakFrameBytes;		// most bytes read from the ROM file in a single frame
+	double runAheadSeconds;		// part of seconds spent running ahead
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Baseline file
+
+static bench_manifest baseline;
+static bench_manifest recorded;
+
+static int32 runAheadFrames = 0;
+static bool bRecordMovies = false;
+static bool bPlayMovies = false;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Benchmark
+
+static int CompareNames(const void* a, const void* b) {
+	return strcmp(*(const char**) a, *(const char**) b);
+}
+
+static void RunROM(const char* romDir, const char* romName, int32 numFrames, bench_result& result) {
+	memset(&result, 0, sizeof(result));
+	strncpy(result.rom, romName, sizeof(result.rom) - 1);
+	result.mismatchFrame = -1;
+	int32 baselineHint = 0;
+	result.hasBaseline = baseline.find(result.rom, 0, baselineHint) != nullptr;
+
+	char romPath[512];
+	snprintf(romPath, sizeof(romPath), "%s/%s", romDir, romName);
+	if (!Host_LoadROM(romPath)) {
+		return;
+	}
+
+	// movies start from power on, before the first frame
+	if (bRecordMovies) {
+		nesMovie.StartRecording(MA_PowerOn);
+	} else if (bPlayMovies && !nesMovie.StartPlayback()) {
+		Host_UnloadROM();
+		result.noMovie = true;
+		return;
+	}
+	result.loaded = true;
+	result.mapper = nesCart.mapper;
+
+	const int32 samplesPerFrame = SOUND_RATE / (nesCart.isPAL ? 50 : 60);
+	int* audio = (int*) malloc(samplesPerFrame * sizeof(int));
+
+	for (int32 frame = 0; frame < numFrames; frame++) {
+		if (!bPlayMovies) {
+			Bench_ApplyScriptedInput(frame);
+		}
+
+		uint32 startInstructions = cpu6502_InstructionCount;
+		double startTime = Host_GetSeconds();
+		Host_RunFrames(1);
+		bool mixed = Host_MixSound(audio, samplesPerFrame);
+		result.seconds += Host_GetSeconds() - startTime;
+		result.instructions += cpu6502_InstructionCount - startInstructions;
+
+		uint32 frameBytes = nesCart.bankStats.bytesRead - result.bankStats.bytesRead;
+		if (frameBytes > result.peakFrameBytes) {
+			result.peakFrameBytes = frameBytes;
+		}
+		result.bankStats = nesCart.bankStats;
+
+		uint32 videoHash = Bench_HashVideo();
+		uint32 audioHash = mixed ? Bench_HashBytes(2166136261u, audio, samplesPerFrame * sizeof(int)) : 0;
+		recorded.add(result.rom, frame, videoHash, audioHash);
+
+		if (result.hasBaseline && result.mismatchFrame == -1) {
+			const bench_frame_hash* expected = baseline.find(result.rom, frame, baselineHint);
+			if (!expected || (expected->video != videoHash && !runAheadFrames) || expected->audio != audioHash) {
+				result.mismatchFrame = frame;
+			}
+		}
+	}
+
+	// GetCycles counts 16 ns units on host
+	result.runAheadSeconds = nesRunAhead.cycles * 16 / 1000000000.0;
+
+	free(audio);
+	Host_UnloadROM();
+}
+
+static void PrintUsage() {
+	printf("usage: nesizm-bench <rom dir> [-frames N] [-baseline file] [-update] [-runahead N] [-record | -movies]");
+}
+
+int main(int argc, char** argv) {
+	if (argc < 2) {
+		PrintUsage();
+		return 1;
+	}
+
+	const char* romDir = argv[1];
+	int32 numFrames = 1800;
+	char baselinePath[512];
+	snprintf(baselinePath, sizeof(baselinePath), "%s/nesizm-bench.txt", romDir);
+	bool bUpdate = false;
+
+	for (int i = 2; i < argc; i++) {
+		if (!strcmp(argv[i], "-frames") && i + 1 < argc) {
+			numFrames = atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "-baseline") && i + 1 < argc) {
+			strncpy(baselinePath, argv[++i], sizeof(baselinePath) - 1);
+		} else if (!strcmp(argv[i], "-update")) {
+			bUpdate = true;
+		} else if (!strcmp(argv[i], "-runahead") && i + 1 < argc) {
+			runAheadFrames = atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "-record")) {
+			bRecordMovies = true;
+		} else if (!strcmp(argv[i], "-movies")) {
+			bPlayMovies = true;
+		} else {
+			PrintUsage();
+			return 1;
+		}
+	}
+
+	// a baseline is never recorded from frames run ahead
+	if (numFrames <= 0 || runAheadFrames < 0 || runAheadFrames > 3 || (bUpdate && runAheadFrames) || (bRecordMovies && bPlayMovies)) {
+		PrintUsage();
+		return 1;
+	}
+
+	// gather ROMs in a stable order
+	DIR* dir = opendir(romDir);
+	if (!dir) {
+		printf("Could not open ROM directory %s", romDir);
+		return 1;
+	}
+
+	const int32 MAX_ROMS = 1024;
+	static char* romNames[MAX_ROMS];
+	int32 numROMs = 0;
+	while (struct dirent* entry = readdir(dir)) {
+		const char* ext = strrchr(entry->d_name, '.');
+		if (ext && (strcasecmp(ext, ".nes") == 0 || strcasecmp(ext, ".nz7") == 0) && numROMs < MAX_ROMS && strlen(entry->d_name) < 64) {
+			romNames[numROMs++] = strdup(entry->d_name);
+		}
+	}
+	closedir(dir);
+	qsort(romNames, numROMs, sizeof(char*), CompareNames);
+
+	if (numROMs == 0) {
+		printf("No .nes or .nz7 files found in %s", romDir);
+		return 1;
+	}
+
+	if (!bUpdate) {
+		baseline.load(baselinePath);
+	}
+
+	// fixed settings so runs are comparable (no frame skip, overlays off, sound on for audio hashing)
+	nesSettings.Load();
+	nesSettings.SetSetting(ST_FrameSkip, 1);
+	nesSettings.SetSetting(ST_ShowClock, 0);
+	nesSettings.SetSetting(ST_ShowFPS, 0);
+	nesSettings.SetSetting(ST_SoundEnabled, 1);
+	nesSettings.SetSetting(ST_RunAhead, runAheadFrames);
+
+	bench_result* results = (bench_result*) calloc(numROMs, sizeof(bench_result));
+
+	printf("Pixel kernels: %s", Host_GetSIMDName());
+	printf("%-40s %6s %8s %10s  %s", "ROM", "Mapper", "FPS", "MInstr/s", "Output");
+	bool bFailed = false;
+	for (int32 i = 0; i < numROMs; i++) {
+		bench_result& result = results[i];
+		RunROM(romDir, romNames[i], numFrames, result);
+
+		if (result.noMovie) {
+			printf("%-40s %6s %8s %10s  %s", result.rom, "-", "-", "-", "NO MOVIE (record with -record)");
+			bFailed = true;
+			continue;
+		}
+		if (!result.loaded) {
+			printf("%-40s %6s %8s %10s  %s", result.rom, "-", "-", "-", "LOAD FAILED");
+			bFailed = true;
+			continue;
+		}
+
+		char status[64];
+		if ((bUpdate || baseline.count == 0) && !runAheadFrames) {
+			strcpy(status, "recorded");
+		} else if (!result.hasBaseline) {
+			strcpy(status, "no baseline (run with -update)");
+		} else if (result.mismatchFrame >= 0) {
+			sprintf(status, "CHANGED at frame %d", result.mismatchFrame);
+			bFailed = true;
+		} else {
+			strcpy(status, "ok");
+		}
+
+		double fps = result.seconds > 0 ? numFrames / result.seconds : 0.0;
+		double mips = result.seconds > 0 ? result.instructions / result.seconds / 1000000.0 : 0.0;
+		printf("%-40s %6d %8.1f %10.2f  %s", result.rom, result.mapper, fps, mips, status);
+	}
+
+	// bank cache use, only when ROMs went through the cache (make -f Makefile.host DIRECT_ROM_MAPPING=0)
+	bool bUsedCache = false;
+	for (int32 i = 0; i < numROMs; i++) {
+		bUsedCache |= results[i].loaded && results[i].bankStats.misses != 0;
+	}
+	if (bUsedCache) {
+		printf("%s", "");
+		printf("%-40s %8s %8s %8s %8s %8s %8s", "Bank cache per frame", "Hits", "Misses", "Prefetch", "Evicts", "KB read", "KB peak");
+		for (int32 i = 0; i < numROMs; i++) {
+			if (!results[i].loaded) {
+				continue;
+			}
+			const nes_bank_stats& stats = results[i].bankStats;
+			printf("%-40s %8.2f %8.2f %8.2f %8.2f %8.2f %8.2f", results[i].rom, double(stats.hits) / numFrames, double(stats.misses) / numFrames,
+				double(stats.prefetches) / numFrames, double(stats.evictions) / numFrames, stats.bytesRead / 1024.0 / numFrames, results[i].peakFrameBytes / 1024.0);
+		}
+	}
+
+	// what running ahead costs on top of each real frame
+	if (runAheadFrames) {
+		printf("%s", "");
+		printf("%-40s %12s %12s", "Run ahead", "Frames", "ms/frame");
+		for (int32 i = 0; i < numROMs; i++) {
+			if (results[i].loaded) {
+				printf("%-40s %12d %12.3f", results[i].rom, runAheadFrames, results[i].runAheadSeconds * 1000.0 / numFrames);
+			}
+		}
+	}
+
+	// per mapper totals
+	printf("%s", "");
+	printf("%-6s %5s %8s %10s", "Mapper", "ROMs", "FPS", "MInstr/s");
+	bool bReported[4096] = { false };
+	double totalSeconds = 0;
+	double totalInstructions = 0;
+	int32 totalROMs = 0;
+	for (int32 i = 0; i < numROMs; i++) {
+		if (!results[i].loaded || bReported[results[i].mapper & 4095]) {
+			continue;
+		}
+		bReported[results[i].mapper & 4095] = true;
+
+		double seconds = 0;
+		double instructions = 0;
+		int32 count = 0;
+		for (int32 j = i; j < numROMs; j++) {
+			if (results[j].loaded && results[j].mapper == results[i].mapper) {
+				seconds += results[j].seconds;
+				instructions += results[j].instructions;
+				count++;
+			}
+		}
+		totalSeconds += seconds;
+		totalInstructions += instructions;
+		totalROMs += count;
+
+		printf("%-6d %5d %8.1f %10.2f", results[i].mapper, count, seconds > 0 ? count * numFrames / seconds : 0.0,
+			seconds > 0 ? instructions / seconds / 1000000.0 : 0.0);
+	}
+	printf("%-6s %5d %8.1f %10.2f", "All", totalROMs, totalSeconds > 0 ? totalROMs * numFrames / totalSeconds : 0.0,
+		totalSeconds > 0 ? totalInstructions / totalSeconds / 1000000.0 : 0.0);
+
+	// a fresh baseline is written when asked for or when none existed
+	if ((bUpdate || baseline.count == 0) && !runAheadFrames) {
+		if (recorded.save(baselinePath, numFrames)) {
+			printf("Wrote baseline %s", baselinePath);
+		} else {
+			printf("Could not write baseline %s", baselinePath);
+			bFailed = true;
+		}
+	}
+
+	if (bFailed) {
+		printf("FAILED: output changed or ROMs failed to load or play their movies");
+	}
+
+	for (int32 i = 0; i < numROMs; i++) {
+		free(romNames[i]);
+	}
+	free(results);
+
+	return bFailed ? 1 : 0;
+}
+
+#endif
@@ -0,0 +1,105 @@
+// nesizm-headless : loads a ROM on the host and runs it for a number of frames with no display, for
+// profiling the emulation core at full speed. With -movie the ROM's recorded movie (.nzm) supplies the input, and runs
+// for its length unless a frame count is given. -video and -audio write the frames and sound out from their own
+// threads (see host_present.h), and -vsync presents frames at the ROM's refresh rate, dropping what doesn't keep up
+
+#if TARGET_HOST
+
+#include "platform.h"
+#include "debug.h"
+#include "nes.h"
+#include "settings.h"
+#include "scope_timer/scope_timer.h"
+#include "host_runner.h"
+#include "host_present.h"
+
+static void PrintUsage() {
+	printf("usage: nesizm-headless <rom.nes> [frames] [-movie] [-video file.raw] [-audio file.wav] [-vsync]");
+}
+
+int main(int argc, char** argv) {
+	if (argc < 2) {
+		PrintUsage();
+		return 1;
+	}
+
+	int numFrames = 0;
+	bool bMovie = false;
+	const char* videoPath = nullptr;
+	const char* audioPath = nullptr;
+	bool bVSync = false;
+	for (int i = 2; i < argc; i++) {
+		if (!strcmp(argv[i], "-movie")) {
+			bMovie = true;
+		} else if (!strcmp(argv[i], "-video") && i + 1 < argc) {
+			videoPath = argv[++i];
+		} else if (!strcmp(argv[i], "-audio") && i + 1 < argc) {
+			audioPath = argv[++i];
+		} else if (!strcmp(argv[i], "-vsync")) {
+			bVSync = true;
+		} else if (numFrames == 0 && atoi(argv[i]) > 0) {
+			numFrames = atoi(argv[i]);
+		} else {
+			PrintUsage();
+			return 1;
+		}
+	}
+
+	ScopeTimer::InitSystem();
+
+	nesSettings.Load();
+
+	// the mixer only runs with sound on
+	if (audioPath) {
+		nesSettings.SetSetting(ST_SoundEnabled, 1);
+	}
+
+	if (!Host_LoadROM(argv[1])) {
+		return 1;
+	}
+
+	if (bMovie) {
+		if (!nesMovie.StartPlayback()) {
+			Host_UnloadROM();
+			return 1;
+		}
+		if (numFrames == 0) {
+			numFrames = nesMovie.numFrames;
+		}
+	} else if (numFrames == 0) {
+		numFrames = 600;
+	}
+
+	const bool bPresent = videoPath || audioPath;
+	if (bPresent && !Host_StartPresenter(videoPath, audioPath, bVSync)) {
+		Host_UnloadROM();
+		return 1;
+	}
+
+	double startTime = Host_GetSeconds();
+	if (bPresent) {
+		for (int frame = 0; frame < numFrames; frame++) {
+			Host_RunFrames(1);
+			Host_PresentFrame();
+		}
+	} else {
+		Host_RunFrames(numFrames);
+	}
+	double elapsed = Host_GetSeconds() - startTime;
+
+	// emulation is timed without waiting for the output to catch up
+	if (bPresent) {
+		Host_StopPresenter();
+	}
+
+	Host_UnloadROM();
+
+	printf("%d frames in %.3f s (%.1f fps)", numFrames, elapsed, elapsed > 0 ? numFrames / elapsed : 0.0);
+
+	ScopeTimer::DisplayTimes();
+	ScopeTimer::Shutdown();
+
+	return 0;
+}
+
+#endif
@@ -0,0 +1,104 @@
+// Frame hashing, scripted input and hash manifests shared by nesizm-bench and nesizm-regress
+
+#if TARGET_HOST
+
+#include "platform.h"
+#include "debug.h"
+#include "nes.h"
+#include "settings.h"
+#include "host_bench.h"
+
+bool bench_manifest::load(const char* path) {
+	FILE* file = fopen(path, "r");
+	if (!file) {
+		return false;
+	}
+
+	char line[256];
+	while (fgets(line, sizeof(line), file)) {
+		bench_frame_hash entry;
+		if (line[0] == '#' || sscanf(line, "%63s %d %x %x", entry.rom, &entry.frame, &entry.video, &entry.audio) != 4) {
+			continue;
+		}
+		add(entry.rom, entry.frame, entry.video, entry.audio);
+	}
+
+	fclose(file);
+	return true;
+}
+
+bool bench_manifest::save(const char* path, int32 numFrames) const {
+	FILE* file = fopen(path, "w");
+	if (!file) {
+		return false;
+	}
+
+	fprintf(file, "# nesizm-bench frame hashes (%d frames per ROM): rom frame video audio\n", numFrames);
+	for (int32 i = 0; i < count; i++) {
+		fprintf(file, "%s %d %08x %08x\n", entries[i].rom, entries[i].frame, entries[i].video, entries[i].audio);
+	}
+
+	fclose(file);
+	return true;
+}
+
+void bench_manifest::add(const char* rom, int32 frame, uint32 video, uint32 audio) {
+	if (count == size) {
+		size = size ? size * 2 : 4096;
+		entries = (bench_frame_hash*) realloc(entries, size * sizeof(bench_frame_hash));
+	}
+
+	bench_frame_hash& entry = entries[count++];
+	strncpy(entry.rom, rom, sizeof(entry.rom) - 1);
+	entry.rom[sizeof(entry.rom) - 1] = 0;
+	entry.frame = frame;
+	entry.video = video;
+	entry.audio = audio;
+}
+
+const bench_frame_hash* bench_manifest::find(const char* rom, int32 frame, int32& hint) const {
+	for (int32 pass = 0; pass < 2; pass++) {
+		for (int32 i = pass ? 0 : hint; i < count; i++) {
+			if (entries[i].frame == frame && strcmp(entries[i].rom, rom) == 0) {
+				hint = i;
+				return &entries[i];
+			}
+		}
+	}
+	return nullptr;
+}
+
+uint32 Bench_HashBytes(uint32 hash, const void* data, int size) {
+	const uint8* bytes = (const uint8*) data;
+	for (int i = 0; i < size; i++) {
+		hash = (hash ^ bytes[i]) * 16777619u;
+	}
+	return hash;
+}
+
+uint32 Bench_HashVideo() {
+	return Bench_HashBytes(2166136261u, GetVRAMAddress(), LCD_WIDTH_PX * LCD_HEIGHT_PX * 2);
+}
+
+void Bench_ApplyScriptedInput(int32 frame) {
+	Host_ClearKeys();
+	if (frame < 60) {
+		return;
+	}
+
+	if (frame % 120 < 4) {
+		Host_SetKeyState(nesSettings.keyMap[NES_P1_START], true);
+	}
+
+	static const NesKeys directions[4] = { NES_P1_RIGHT, NES_P1_DOWN, NES_P1_LEFT, NES_P1_UP };
+	Host_SetKeyState(nesSettings.keyMap[directions[(frame / 40) % 4]], true);
+
+	if ((frame / 7) % 3 == 0) {
+		Host_SetKeyState(nesSettings.keyMap[NES_P1_A], true);
+	}
+	if ((frame / 11) % 4 == 0) {
+		Host_SetKeyState(nesSettings.keyMap[NES_P1_B], true);
+	}
+}
+
+#endif
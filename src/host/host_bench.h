@@ -0,0 +1,41 @@
+// Frame hashing, scripted input and hash manifests shared by nesizm-bench and nesizm-regress
+#pragma once
+
+#include "platform.h"
+
+struct bench_frame_hash {
+	char rom[64];
+	int32 frame;
+	uint32 video;
+	uint32 audio;
+};
+
+// the frame hashes of a ROM directory (nesizm-bench.txt), one line per frame: rom frame video audio
+struct bench_manifest {
+	bench_frame_hash* entries;
+	int32 count;
+	int32 size;
+
+	bench_manifest() : entries(nullptr), count(0), size(0) {}
+	~bench_manifest() {
+		free(entries);
+	}
+
+	// false if the file could not be opened
+	bool load(const char* path);
+	bool save(const char* path, int32 numFrames) const;
+
+	void add(const char* rom, int32 frame, uint32 video, uint32 audio);
+
+	// frames for one ROM are contiguous, so the search starts where the last one matched (hint, 0 at first)
+	const bench_frame_hash* find(const char* rom, int32 frame, int32& hint) const;
+};
+
+// FNV-1a
+uint32 Bench_HashBytes(uint32 hash, const void* data, int size);
+
+// hash of the screen as last drawn
+uint32 Bench_HashVideo();
+
+// fixed input script : idle at boot, tap start every 2 seconds, and walk through the directions and buttons
+void Bench_ApplyScriptedInput(int32 frame);
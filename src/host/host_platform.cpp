@@ -0,0 +1,370 @@
+// POSIX implementation of the SDK calls the emulation core relies on (TARGET_HOST only)
+
+#if TARGET_HOST
+
+#include "platform.h"
+#include "debug.h"
+#include "snd/snd.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Display
+
+static MACHINE_STATE unsigned short hostVRAM[LCD_WIDTH_PX * LCD_HEIGHT_PX] ALIGN(16);
+
+void* GetVRAMAddress(void) {
+	return hostVRAM;
+}
+
+void Bdisp_PutDisp_DD(void) {
+	// headless, nothing to present
+}
+
+void Bdisp_EnableColor(int) {
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Files
+
+static MACHINE_STATE char storageRoot[256] = ".";
+
+void Host_SetStorageRoot(const char* path) {
+	strncpy(storageRoot, path, sizeof(storageRoot) - 1);
+	storageRoot[sizeof(storageRoot) - 1] = 0;
+}
+
+struct host_file {
+	int fd;
+	unsigned char* data;		// whole file mapping, created on first Bfile_GetBlockAddress
+	int dataSize;
+};
+
+// handle 0 is reserved since the cart treats it as 'no file'
+const int MAX_HOST_FILES = 16;
+static MACHINE_STATE host_file hostFiles[MAX_HOST_FILES];
+
+static host_file* getHostFile(int handle) {
+	if (handle <= 0 || handle >= MAX_HOST_FILES || hostFiles[handle].fd <= 0) {
+		return nullptr;
+	}
+	return &hostFiles[handle];
+}
+
+// converts a Bfile name (\\fls0\dir\file.nes) to a path inside the storage root
+static void resolveHostPath(const unsigned short* filename, char* intoPath, int pathSize) {
+	char name[256];
+	int len = 0;
+	while (filename[len] && len < 255) {
+		name[len] = (char) filename[len];
+		len++;
+	}
+	name[len] = 0;
+
+	const char* relative = name;
+	if (strncmp(relative, "\\\\fls0\\", 7) == 0) {
+		relative += 7;
+	}
+
+	snprintf(intoPath, pathSize, "%s/%s", storageRoot, relative);
+	for (char* c = intoPath; *c; c++) {
+		if (*c == '\\') *c = '/';
+	}
+}
+
+void Bfile_StrToName_ncpy(unsigned short* dest, const char* source, size_t n) {
+	size_t i = 0;
+	for (; i < n && source[i]; i++) {
+		dest[i] = (unsigned char) source[i];
+	}
+	if (i < n) {
+		dest[i] = 0;
+	}
+}
+
+int Bfile_OpenFile_OS(const unsigned short* filename, int mode, int) {
+	char path[512];
+	resolveHostPath(filename, path, sizeof(path));
+
+	int flags = O_RDONLY;
+	if (mode == WRITE) flags = O_WRONLY;
+	else if (mode == READWRITE || mode == READWRITE_SHARE) flags = O_RDWR;
+
+	int fd = open(path, flags);
+	if (fd < 0) {
+		return -1;
+	}
+
+	for (int i = 1; i < MAX_HOST_FILES; i++) {
+		if (hostFiles[i].fd <= 0) {
+			hostFiles[i].fd = fd;
+			hostFiles[i].data = nullptr;
+			hostFiles[i].dataSize = 0;
+			return i;
+		}
+	}
+
+	close(fd);
+	return -1;
+}
+
+int Bfile_CloseFile_OS(int handle) {
+	host_file* file = getHostFile(handle);
+	if (!file) {
+		return -1;
+	}
+
+	close(file->fd);
+	Host_UnmapFile(file->data, file->dataSize);
+	file->fd = 0;
+	file->data = nullptr;
+	file->dataSize = 0;
+	return 0;
+}
+
+int Bfile_ReadFile_OS(int handle, void* buf, int size, int readpos) {
+	host_file* file = getHostFile(handle);
+	if (!file) {
+		return -1;
+	}
+
+	if (readpos >= 0) {
+		lseek(file->fd, readpos, SEEK_SET);
+	}
+	return (int) read(file->fd, buf, size);
+}
+
+int Bfile_WriteFile_OS(int handle, const void* buf, int size) {
+	host_file* file = getHostFile(handle);
+	if (!file) {
+		return -1;
+	}
+
+	return (int) write(file->fd, buf, size);
+}
+
+int Bfile_SeekFile_OS(int handle, int pos) {
+	host_file* file = getHostFile(handle);
+	if (!file) {
+		return -1;
+	}
+
+	return (int) lseek(file->fd, pos, SEEK_SET);
+}
+
+int Bfile_TellFile_OS(int handle) {
+	host_file* file = getHostFile(handle);
+	if (!file) {
+		return -1;
+	}
+
+	return (int) lseek(file->fd, 0, SEEK_CUR);
+}
+
+int Bfile_GetFileSize_OS(int handle) {
+	host_file* file = getHostFile(handle);
+	if (!file) {
+		return -1;
+	}
+
+	struct stat info;
+	if (fstat(file->fd, &info) != 0) {
+		return -1;
+	}
+	return (int) info.st_size;
+}
+
+int Bfile_CreateEntry_OS(const unsigned short* filename, int mode, size_t* size) {
+	char path[512];
+	resolveHostPath(filename, path, sizeof(path));
+
+	if (mode == CREATEMODE_FOLDER) {
+		return mkdir(path, 0755) == 0 ? 0 : -1;
+	}
+
+	int fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0644);
+	if (fd < 0) {
+		// matches the OS, which refuses to create over an existing entry
+		return -1;
+	}
+
+	int result = 0;
+	if (size && ftruncate(fd, *size) != 0) {
+		result = -1;
+	}
+	close(fd);
+	return result;
+}
+
+int Bfile_DeleteEntry(const unsigned short* filename) {
+	char path[512];
+	resolveHostPath(filename, path, sizeof(path));
+	return unlink(path) == 0 ? 0 : -1;
+}
+
+// maps size bytes of the file, rounded up to a whole block so partial blocks can be read as if full
+static unsigned char* mapHostFile(int fd, int fileSize, int* mappedSize) {
+	int mapSize = (fileSize + 4095) & ~4095;
+	if (mapSize == 0) {
+		return nullptr;
+	}
+
+	// private so game genie patches to mapped PRG never reach the file
+	void* data = mmap(nullptr, mapSize, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	if (data == MAP_FAILED) {
+		return nullptr;
+	}
+
+	*mappedSize = mapSize;
+	return (unsigned char*) data;
+}
+
+// the OS hands out pointers into flash for each 4 KB block, on host the file is memory mapped instead
+int Bfile_GetBlockAddress(int handle, int pos, unsigned char** address) {
+	host_file* file = getHostFile(handle);
+	if (!file) {
+		return -1;
+	}
+
+	if (!file->data) {
+		int fileSize = Bfile_GetFileSize_OS(handle);
+		if (fileSize < 0) {
+			return -1;
+		}
+
+		file->data = mapHostFile(file->fd, fileSize, &file->dataSize);
+		if (!file->data) {
+			return -1;
+		}
+	}
+
+	if (pos < 0 || pos >= file->dataSize) {
+		return -1;
+	}
+
+	*address = file->data + pos;
+	return 0;
+}
+
+unsigned char* Host_MapFile(const unsigned short* filename, int* size) {
+	char path[512];
+	resolveHostPath(filename, path, sizeof(path));
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return nullptr;
+	}
+
+	// the mapping outlives the descriptor
+	struct stat info;
+	unsigned char* data = nullptr;
+	int mappedSize;
+	if (fstat(fd, &info) == 0) {
+		data = mapHostFile(fd, (int) info.st_size, &mappedSize);
+		*size = (int) info.st_size;
+	}
+	close(fd);
+	return data;
+}
+
+void Host_UnmapFile(unsigned char* data, int size) {
+	if (data) {
+		munmap(data, size);
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Main memory
+
+int MCSGetDlen2(unsigned char*, unsigned char*, int* len) {
+	*len = 0;
+	return -1;
+}
+
+int MCSGetData1(int, int, void*) {
+	return -1;
+}
+
+int MCS_CreateDirectory(unsigned char*) {
+	return 0;
+}
+
+int MCS_WriteItem(unsigned char*, unsigned char*, short, int, void*) {
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Clock / System
+
+int RTC_GetTicks(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (int) (now.tv_sec * 128 + now.tv_nsec / (1000000000 / 128));
+}
+
+void RTC_GetTime(unsigned int* hour, unsigned int* minute, unsigned int* second, unsigned int* millisecond) {
+	struct timespec now;
+	clock_gettime(CLOCK_REALTIME, &now);
+	time_t seconds = now.tv_sec;
+	struct tm local;
+	localtime_r(&seconds, &local);
+
+	*hour = local.tm_hour;
+	*minute = local.tm_min;
+	*second = local.tm_sec;
+	*millisecond = now.tv_nsec / 1000000;
+}
+
+int getDeviceType(void) {
+	return DT_CG50;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Keyboard
+
+static MACHINE_STATE bool hostKeys[256];
+
+bool keyDown_fast(unsigned char keyCode) {
+	return hostKeys[keyCode];
+}
+
+void Host_SetKeyState(unsigned char keyCode, bool isDown) {
+	hostKeys[keyCode] = isDown;
+}
+
+void Host_ClearKeys() {
+	memset(hostKeys, 0, sizeof(hostKeys));
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Sound
+
+static MACHINE_STATE bool hostSoundActive = false;
+
+void sndInit() {
+	hostSoundActive = true;
+}
+
+void sndCleanup() {
+	hostSoundActive = false;
+}
+
+void sndVolumeUp() {
+}
+
+void sndVolumeDown() {
+}
+
+bool Host_MixSound(int* buffer, int length) {
+	if (!hostSoundActive) {
+		return false;
+	}
+
+	sndFrame(buffer, length);
+	return true;
+}
+
+#endif
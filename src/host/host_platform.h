@@ -0,0 +1,70 @@
+// Host (Linux/POSIX) stand ins for the fxcg SDK, used when building with TARGET_HOST
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// display
+#define LCD_WIDTH_PX 384
+#define LCD_HEIGHT_PX 216
+
+#define COLOR_BLACK			0x0000
+#define COLOR_WHITE			0xFFFF
+#define COLOR_RED			0xF800
+#define COLOR_LIGHTGREEN	0x9772
+#define COLOR_LIGHTBLUE		0xAEDC
+#define COLOR_SALMON		0xFC0E
+
+// VRAM is a plain 384x216 16-bit buffer owned by the host layer
+void* GetVRAMAddress(void);
+void Bdisp_PutDisp_DD(void);
+void Bdisp_EnableColor(int n);
+
+// file system (paths starting with \\fls0\ resolve relative to the host storage root)
+#define READ 0
+#define READ_SHARE 1
+#define WRITE 2
+#define READWRITE 3
+#define READWRITE_SHARE 4
+
+#define CREATEMODE_FILE 1
+#define CREATEMODE_FOLDER 5
+
+void Bfile_StrToName_ncpy(unsigned short* dest, const char* source, size_t n);
+int Bfile_OpenFile_OS(const unsigned short* filename, int mode, int zero);
+int Bfile_CloseFile_OS(int handle);
+int Bfile_ReadFile_OS(int handle, void* buf, int size, int readpos);
+int Bfile_WriteFile_OS(int handle, const void* buf, int size);
+int Bfile_SeekFile_OS(int handle, int pos);
+int Bfile_TellFile_OS(int handle);
+int Bfile_GetFileSize_OS(int handle);
+int Bfile_CreateEntry_OS(const unsigned short* filename, int mode, size_t* size);
+int Bfile_DeleteEntry(const unsigned short* filename);
+int Bfile_GetBlockAddress(int handle, int pos, unsigned char** address);
+
+// main memory storage (settings are not persisted on host, defaults are always used)
+int MCSGetDlen2(unsigned char* dir, unsigned char* item, int* len);
+int MCSGetData1(int offset, int len_to_copy, void* buffer);
+int MCS_CreateDirectory(unsigned char* dir);
+int MCS_WriteItem(unsigned char* dir, unsigned char* item, short itemtype, int data_length, void* buffer);
+
+// clock (ticks are 1/128 of a second, like the OS)
+int RTC_GetTicks(void);
+void RTC_GetTime(unsigned int* hour, unsigned int* minute, unsigned int* second, unsigned int* millisecond);
+
+// system
+#define DT_CG20 1
+#define DT_CG50 2
+int getDeviceType(void);
+
+// keyboard, key codes match the Prizm keyDown_fast codes
+bool keyDown_fast(unsigned char keyCode);
+
+// host only helpers
+void Host_SetStorageRoot(const char* path);
+void Host_SetKeyState(unsigned char keyCode, bool isDown);
+void Host_ClearKeys();
+
+// maps a whole file into memory copy-on-write (writes stay private) and sets size to the file size, returns NULL on failure
+unsigned char* Host_MapFile(const unsigned short* filename, int* size);
+void Host_UnmapFile(unsigned char* data, int size);
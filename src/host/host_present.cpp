@@ -0,0 +1,248 @@
+// Frame and audio output threads (see host_present.h)
+
+#if TARGET_HOST
+
+#include "platform.h"
+#include "debug.h"
+#include "nes.h"
+#include "snd/snd.h"
+#include "host_runner.h"
+#include "host_present.h"
+#include "host_spsc.h"
+
+#include <pthread.h>
+#include <unistd.h>
+
+// a few frames of slack, beyond that the consumer is behind for good and frames are better dropped
+#define PRESENT_QUEUE_SLOTS 8
+#define AUDIO_QUEUE_SLOTS 16
+
+struct host_output {
+	host_spsc_queue queue;
+	FILE* file;
+	pthread_t thread;
+	bool bStarted;
+	double frameSeconds;		// time between slots when paced like a display, 0 to write as soon as queued
+	int32 written;				// slots written by the consumer, read once it is joined
+	int32 dropped;				// slots the producer found no room for
+
+	void (*write)(host_output& output, const uint8* slot);
+};
+
+// one presenter per process, fed by the thread running the machine
+static host_output video;
+static host_output audio;
+static std::atomic<bool> bStopping;
+static int32 samplesPerFrame = 0;
+static int32 wavDataBytes = 0;
+static int* droppedAudio = nullptr;
+
+static void WriteVideo(host_output& output, const uint8* slot) {
+	fwrite(slot, output.queue.slotSize, 1, output.file);
+}
+
+// the mix has no device to clip it, so it is clamped into 16 bits as is
+static void WriteAudio(host_output& output, const uint8* slot) {
+	const int* samples = (const int*) slot;
+	int16 converted[SOUND_RATE / 50];
+	for (int32 i = 0; i < samplesPerFrame; i++) {
+		converted[i] = (int16) max(-32768, min(32767, samples[i]));
+		ShortSwap_Little(converted[i]);
+	}
+	fwrite(converted, sizeof(int16), samplesPerFrame, output.file);
+	wavDataBytes += samplesPerFrame * sizeof(int16);
+}
+
+static void* OutputThread(void* param) {
+	host_output& output = *(host_output*) param;
+	double nextFrame = Host_GetSeconds();
+
+	for (;;) {
+		const uint8* slot = output.queue.beginPop();
+		if (!slot) {
+			// anything pushed before the stop is visible once the stop is, so look once more before leaving
+			const bool bDone = bStopping.load(std::memory_order_acquire);
+			if (bDone && !output.queue.beginPop()) {
+				break;
+			}
+			if (!bDone) {
+				usleep(500);
+			}
+			continue;
+		}
+
+		// wait for the next refresh like a display would, starting over after falling a whole frame behind
+		if (output.frameSeconds > 0) {
+			const double now = Host_GetSeconds();
+			if (nextFrame > now) {
+				usleep((useconds_t) ((nextFrame - now) * 1000000.0));
+			} else if (now - nextFrame > output.frameSeconds) {
+				nextFrame = now;
+			}
+			nextFrame += output.frameSeconds;
+		}
+
+		output.write(output, slot);
+		output.queue.endPop();
+		output.written++;
+	}
+
+	return nullptr;
+}
+
+static void WriteWAVHeader(FILE* file, int32 dataBytes) {
+	struct {
+		char riff[4];
+		uint32 riffSize;
+		char wave[4];
+		char fmt[4];
+		uint32 fmtSize;
+		uint16 format;
+		uint16 channels;
+		uint32 sampleRate;
+		uint32 byteRate;
+		uint16 blockAlign;
+		uint16 bitsPerSample;
+		char data[4];
+		uint32 dataSize;
+	} header;
+
+	memcpy(header.riff, "RIFF", 4);
+	header.riffSize = 36 + dataBytes;
+	memcpy(header.wave, "WAVE", 4);
+	memcpy(header.fmt, "fmt ", 4);
+	header.fmtSize = 16;
+	header.format = 1;
+	header.channels = 1;
+	header.sampleRate = SOUND_RATE;
+	header.byteRate = SOUND_RATE * 2;
+	header.blockAlign = 2;
+	header.bitsPerSample = 16;
+	memcpy(header.data, "data", 4);
+	header.dataSize = dataBytes;
+	EndianSwap_Little(header.riffSize);
+	EndianSwap_Little(header.fmtSize);
+	ShortSwap_Little(header.format);
+	ShortSwap_Little(header.channels);
+	EndianSwap_Little(header.sampleRate);
+	EndianSwap_Little(header.byteRate);
+	ShortSwap_Little(header.blockAlign);
+	ShortSwap_Little(header.bitsPerSample);
+	EndianSwap_Little(header.dataSize);
+
+	fseek(file, 0, SEEK_SET);
+	fwrite(&header, sizeof(header), 1, file);
+}
+
+static bool OpenOutput(host_output& output, const char* path) {
+	output.file = fopen(path, "wb");
+	if (!output.file) {
+		printf("Could not open %s", path);
+		return false;
+	}
+	return true;
+}
+
+static bool StartOutput(host_output& output, int32 slotSize, uint32 numSlots, void (*write)(host_output&, const uint8*)) {
+	if (!output.queue.init(slotSize, numSlots)) {
+		printf("No memory for output queue");
+		return false;
+	}
+
+	output.write = write;
+	output.written = 0;
+	output.dropped = 0;
+	if (pthread_create(&output.thread, nullptr, OutputThread, &output) != 0) {
+		printf("Could not start output thread");
+		return false;
+	}
+	output.bStarted = true;
+	return true;
+}
+
+static void StopOutput(host_output& output, const char* name) {
+	if (output.bStarted) {
+		pthread_join(output.thread, nullptr);
+		output.bStarted = false;
+		printf("%s: %d written, %d dropped", name, output.written, output.dropped);
+	}
+	output.queue.destroy();
+}
+
+static void CloseOutput(host_output& output) {
+	if (output.file) {
+		fclose(output.file);
+		output.file = nullptr;
+	}
+}
+
+bool Host_StartPresenter(const char* videoPath, const char* audioPath, bool bVSync) {
+	bStopping.store(false, std::memory_order_relaxed);
+	samplesPerFrame = SOUND_RATE / (nesCart.isPAL ? 50 : 60);
+
+	video.frameSeconds = bVSync ? (nesCart.isPAL ? 1.0 / 50 : 1.0 / 60) : 0.0;
+	if (videoPath && (!OpenOutput(video, videoPath) || !StartOutput(video, LCD_WIDTH_PX * LCD_HEIGHT_PX * 2, PRESENT_QUEUE_SLOTS, WriteVideo))) {
+		Host_StopPresenter();
+		return false;
+	}
+
+	audio.frameSeconds = 0.0;
+	if (audioPath) {
+		wavDataBytes = 0;
+		droppedAudio = (int*) malloc(samplesPerFrame * sizeof(int));
+		if (!droppedAudio || !OpenOutput(audio, audioPath)) {
+			Host_StopPresenter();
+			return false;
+		}
+
+		// the sizes are filled in once the data is written
+		WriteWAVHeader(audio.file, 0);
+		if (!StartOutput(audio, samplesPerFrame * sizeof(int), AUDIO_QUEUE_SLOTS, WriteAudio)) {
+			Host_StopPresenter();
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void Host_PresentFrame() {
+	if (video.bStarted) {
+		if (uint8* slot = video.queue.beginPush()) {
+			memcpy(slot, GetVRAMAddress(), video.queue.slotSize);
+			video.queue.endPush();
+		} else {
+			video.dropped++;
+		}
+	}
+
+	// a dropped frame of audio is still mixed so the channels carry on from where they were
+	if (audio.bStarted) {
+		if (uint8* slot = audio.queue.beginPush()) {
+			if (!Host_MixSound((int*) slot, samplesPerFrame)) {
+				memset(slot, 0, samplesPerFrame * sizeof(int));
+			}
+			audio.queue.endPush();
+		} else {
+			Host_MixSound(droppedAudio, samplesPerFrame);
+			audio.dropped++;
+		}
+	}
+}
+
+void Host_StopPresenter() {
+	bStopping.store(true, std::memory_order_release);
+	StopOutput(video, "Video frames");
+	StopOutput(audio, "Audio frames");
+
+	if (audio.file) {
+		WriteWAVHeader(audio.file, wavDataBytes);
+	}
+	CloseOutput(video);
+	CloseOutput(audio);
+
+	free(droppedAudio);
+	droppedAudio = nullptr;
+}
+
+#endif
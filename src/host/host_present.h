@@ -0,0 +1,15 @@
+// Frame and audio output on their own threads, fed through lock-free queues so emulation never waits on output
+#pragma once
+
+#include "platform.h"
+
+// starts the present thread (raw RGB565 frames to videoPath) and the audio thread (16 bit mono WAV to audioPath) for
+// the loaded ROM, either path may be null. With bVSync frames are presented at the ROM's frame rate like a display
+bool Host_StartPresenter(const char* videoPath, const char* audioPath, bool bVSync);
+
+// queues the frame that just finished and mixes its audio straight into the audio queue, either is dropped when its
+// thread is too far behind. Called from the thread running the machine
+void Host_PresentFrame();
+
+// lets both threads finish what is queued, then reports what was written and dropped
+void Host_StopPresenter();
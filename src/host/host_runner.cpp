@@ -0,0 +1,81 @@
+// Shared ROM loading and frame loop for the host executables
+
+#if TARGET_HOST
+
+#include "platform.h"
+#include "debug.h"
+#include "nes.h"
+#include "settings.h"
+#include "host_runner.h"
+
+// set by the PPU when the menu key is pressed (owned by the frontend on device)
+MACHINE_STATE bool shouldExit = false;
+
+static MACHINE_STATE bool bBanksAllocated = false;
+
+double Host_GetSeconds() {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / 1000000000.0;
+}
+
+bool Host_LoadROM(const char* romPath) {
+	if (!bBanksAllocated) {
+		static MACHINE_STATE unsigned char staticBanks[STATIC_CACHED_ROM_BANKS * 8192] ALIGN(256);
+		nesCart.allocateBanks(staticBanks);
+		bBanksAllocated = true;
+	}
+
+	// the ROM directory stands in for the root of storage memory
+	char romDir[256];
+	strncpy(romDir, romPath, sizeof(romDir) - 1);
+	romDir[sizeof(romDir) - 1] = 0;
+	const char* romName = romPath;
+	char* lastSlash = strrchr(romDir, '/');
+	if (lastSlash) {
+		*lastSlash = 0;
+		romName = romPath + (lastSlash - romDir) + 1;
+		Host_SetStorageRoot(romDir[0] ? romDir : "/");
+	} else {
+		Host_SetStorageRoot(".");
+	}
+
+	cpu6502_Init();
+	nesPPU.init();
+	Host_ClearKeys();
+
+	char romFile[128];
+	sprintf(romFile, "\\\\fls0\\%s", romName);
+	if (!nesCart.loadROM(romFile)) {
+		return false;
+	}
+	mainCPU.reset();
+
+	nesAPU.startup();
+	nesPPU.initPalette();
+	return true;
+}
+
+void Host_UnloadROM() {
+	nesAPU.shutdown();
+	nesCart.OnPause();
+
+	// releases the ROM mapping and chunk buffers, the next ROM may be of another kind
+	nesCart.unload();
+}
+
+// same emulation loop as nes_frontend::RunGameLoop, but bounded by frame count instead of the menu key. A frame ends
+// with the PPU step for scanline 242, which is watched for instead of the frame counter since rewinding moves it back
+void Host_RunFrames(int numFrames) {
+	for (int frame = 0; frame < numFrames && !shouldExit; frame++) {
+		bool bFrameDone = false;
+		while (!bFrameDone && !shouldExit) {
+			const unsigned int scanline = nesPPU.scanline;
+			cpu6502_Step();
+			mainCPU.dispatchEvents();
+			bFrameDone = scanline == 242 && nesPPU.scanline == 243;
+		}
+	}
+}
+
+#endif
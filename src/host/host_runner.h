@@ -0,0 +1,16 @@
+// Shared ROM loading and frame loop for the host executables
+#pragma once
+
+#include "platform.h"
+
+// loads the ROM at the given host path (its directory becomes the storage root), false on error
+bool Host_LoadROM(const char* romPath);
+
+// flushes battery RAM and closes the current ROM
+void Host_UnloadROM();
+
+// runs the emulation loop until the given number of frames have completed
+void Host_RunFrames(int numFrames);
+
+// monotonic wall clock in seconds
+double Host_GetSeconds();
@@ -0,0 +1,265 @@
+// Vectorized pixel kernels for host builds. The Prizm runs the SH4 assembly in src/asm instead, so these only
+// keep desktop profiling and regression runs from being bound by scalar byte loops.
+
+#if TARGET_HOST
+
+#include "platform.h"
+#include "debug.h"
+#include "host_simd.h"
+
+#include <atomic>
+#include <pthread.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SIMD_X86 1
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define SIMD_NEON 1
+#endif
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Scalar
+
+static void resolvePalette_Scalar(uint16* dest, const uint8* src, const uint16* palette, int count) {
+	for (int i = 0; i < count; i++) {
+		dest[i] = palette[(src[i] >> 1) & 0x1F];
+	}
+}
+
+static void decodeTile_Scalar(const uint8* pattern, uint8* rows) {
+	for (int r = 0; r < 8; r++) {
+		for (int x = 0; x < 8; x++) {
+			const int bit = 7 - x;
+			rows[r * 8 + x] = (((pattern[r] >> bit) & 1) << 1) | (((pattern[r + 8] >> bit) & 1) << 2);
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// SSSE3 / AVX2
+
+#if SIMD_X86
+// splits the 32 entry palette into low and high byte tables for entries 0-15 and 16-31
+__attribute__((target("ssse3")))
+static void splitPalette_SSSE3(const uint16* palette, __m128i& lo0, __m128i& lo1, __m128i& hi0, __m128i& hi1) {
+	const __m128i evenBytes = _mm_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14, -1, -1, -1, -1, -1, -1, -1, -1);
+	const __m128i oddBytes = _mm_setr_epi8(1, 3, 5, 7, 9, 11, 13, 15, -1, -1, -1, -1, -1, -1, -1, -1);
+
+	__m128i p[4];
+	for (int i = 0; i < 4; i++) {
+		p[i] = _mm_loadu_si128((const __m128i*) (palette + i * 8));
+	}
+
+	lo0 = _mm_unpacklo_epi64(_mm_shuffle_epi8(p[0], evenBytes), _mm_shuffle_epi8(p[1], evenBytes));
+	lo1 = _mm_unpacklo_epi64(_mm_shuffle_epi8(p[2], evenBytes), _mm_shuffle_epi8(p[3], evenBytes));
+	hi0 = _mm_unpacklo_epi64(_mm_shuffle_epi8(p[0], oddBytes), _mm_shuffle_epi8(p[1], oddBytes));
+	hi1 = _mm_unpacklo_epi64(_mm_shuffle_epi8(p[2], oddBytes), _mm_shuffle_epi8(p[3], oddBytes));
+}
+
+__attribute__((target("ssse3")))
+static void resolvePalette_SSSE3(uint16* dest, const uint8* src, const uint16* palette, int count) {
+	__m128i lo0, lo1, hi0, hi1;
+	splitPalette_SSSE3(palette, lo0, lo1, hi0, hi1);
+
+	const __m128i indexMask = _mm_set1_epi8(0x1F);
+	const __m128i nibbleMask = _mm_set1_epi8(0x0F);
+	const __m128i zeroLane = _mm_set1_epi8((char) 0x80);
+	const __m128i fifteen = _mm_set1_epi8(15);
+
+	int i = 0;
+	for (; i + 16 <= count; i += 16) {
+		__m128i index = _mm_and_si128(_mm_srli_epi16(_mm_loadu_si128((const __m128i*) (src + i)), 1), indexMask);
+
+		// pshufb only sees 16 entries, so look up both halves and zero the lanes that belong to the other
+		__m128i upper = _mm_cmpgt_epi8(index, fifteen);
+		__m128i index0 = _mm_or_si128(index, _mm_and_si128(upper, zeroLane));
+		__m128i index1 = _mm_or_si128(_mm_and_si128(index, nibbleMask), _mm_andnot_si128(upper, zeroLane));
+
+		__m128i lo = _mm_or_si128(_mm_shuffle_epi8(lo0, index0), _mm_shuffle_epi8(lo1, index1));
+		__m128i hi = _mm_or_si128(_mm_shuffle_epi8(hi0, index0), _mm_shuffle_epi8(hi1, index1));
+
+		_mm_storeu_si128((__m128i*) (dest + i), _mm_unpacklo_epi8(lo, hi));
+		_mm_storeu_si128((__m128i*) (dest + i + 8), _mm_unpackhi_epi8(lo, hi));
+	}
+
+	resolvePalette_Scalar(dest + i, src + i, palette, count - i);
+}
+
+__attribute__((target("avx2")))
+static void resolvePalette_AVX2(uint16* dest, const uint8* src, const uint16* palette, int count) {
+	__m128i lo0_128, lo1_128, hi0_128, hi1_128;
+	splitPalette_SSSE3(palette, lo0_128, lo1_128, hi0_128, hi1_128);
+
+	// vpshufb works within each 128 bit lane, so both lanes get the same tables
+	const __m256i lo0 = _mm256_broadcastsi128_si256(lo0_128);
+	const __m256i lo1 = _mm256_broadcastsi128_si256(lo1_128);
+	const __m256i hi0 = _mm256_broadcastsi128_si256(hi0_128);
+	const __m256i hi1 = _mm256_broadcastsi128_si256(hi1_128);
+
+	const __m256i indexMask = _mm256_set1_epi8(0x1F);
+	const __m256i nibbleMask = _mm256_set1_epi8(0x0F);
+	const __m256i zeroLane = _mm256_set1_epi8((char) 0x80);
+	const __m256i fifteen = _mm256_set1_epi8(15);
+
+	int i = 0;
+	for (; i + 32 <= count; i += 32) {
+		__m256i index = _mm256_and_si256(_mm256_srli_epi16(_mm256_loadu_si256((const __m256i*) (src + i)), 1), indexMask);
+
+		__m256i upper = _mm256_cmpgt_epi8(index, fifteen);
+		__m256i index0 = _mm256_or_si256(index, _mm256_and_si256(upper, zeroLane));
+		__m256i index1 = _mm256_or_si256(_mm256_and_si256(index, nibbleMask), _mm256_andnot_si256(upper, zeroLane));
+
+		__m256i lo = _mm256_or_si256(_mm256_shuffle_epi8(lo0, index0), _mm256_shuffle_epi8(lo1, index1));
+		__m256i hi = _mm256_or_si256(_mm256_shuffle_epi8(hi0, index0), _mm256_shuffle_epi8(hi1, index1));
+
+		// unpacking is per lane too: first holds pixels 0-7 and 16-23, second 8-15 and 24-31
+		__m256i first = _mm256_unpacklo_epi8(lo, hi);
+		__m256i second = _mm256_unpackhi_epi8(lo, hi);
+		_mm256_storeu_si256((__m256i*) (dest + i), _mm256_permute2x128_si256(first, second, 0x20));
+		_mm256_storeu_si256((__m256i*) (dest + i + 16), _mm256_permute2x128_si256(first, second, 0x31));
+	}
+
+	resolvePalette_SSSE3(dest + i, src + i, palette, count - i);
+}
+
+__attribute__((target("ssse3")))
+static void decodeTile_SSSE3(const uint8* pattern, uint8* rows) {
+	const __m128i planes = _mm_loadu_si128((const __m128i*) pattern);
+	const __m128i bits = _mm_setr_epi8(
+		(char) 0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01,
+		(char) 0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01);
+	const __m128i two = _mm_set1_epi8(2);
+	const __m128i four = _mm_set1_epi8(4);
+
+	// two rows per register, each plane byte repeated across its row's 8 pixels
+	for (int r = 0; r < 8; r += 2) {
+		const __m128i select0 = _mm_setr_epi8(r, r, r, r, r, r, r, r, r + 1, r + 1, r + 1, r + 1, r + 1, r + 1, r + 1, r + 1);
+		const __m128i select1 = _mm_add_epi8(select0, _mm_set1_epi8(8));
+
+		__m128i plane0 = _mm_cmpeq_epi8(_mm_and_si128(_mm_shuffle_epi8(planes, select0), bits), bits);
+		__m128i plane1 = _mm_cmpeq_epi8(_mm_and_si128(_mm_shuffle_epi8(planes, select1), bits), bits);
+
+		__m128i pixels = _mm_or_si128(_mm_and_si128(plane0, two), _mm_and_si128(plane1, four));
+		_mm_storeu_si128((__m128i*) (rows + r * 8), pixels);
+	}
+}
+#endif
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// NEON
+
+#if SIMD_NEON
+static void resolvePalette_NEON(uint16* dest, const uint8* src, const uint16* palette, int count) {
+	// de-interleaving load gives the low and high byte tables for all 32 entries
+	const uint8x16x2_t entries0 = vld2q_u8((const uint8*) palette);
+	const uint8x16x2_t entries1 = vld2q_u8((const uint8*) (palette + 16));
+	const uint8x16x2_t lo = { { entries0.val[0], entries1.val[0] } };
+	const uint8x16x2_t hi = { { entries0.val[1], entries1.val[1] } };
+	const uint8x16_t indexMask = vdupq_n_u8(0x1F);
+
+	int i = 0;
+	for (; i + 16 <= count; i += 16) {
+		uint8x16_t index = vandq_u8(vshrq_n_u8(vld1q_u8(src + i), 1), indexMask);
+
+		uint8x16x2_t colors;
+		colors.val[0] = vqtbl2q_u8(lo, index);
+		colors.val[1] = vqtbl2q_u8(hi, index);
+		vst2q_u8((uint8*) (dest + i), colors);
+	}
+
+	resolvePalette_Scalar(dest + i, src + i, palette, count - i);
+}
+
+static void decodeTile_NEON(const uint8* pattern, uint8* rows) {
+	static const uint8 bitValues[8] = { 0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01 };
+	const uint8x8_t bits = vld1_u8(bitValues);
+	const uint8x8_t two = vdup_n_u8(2);
+	const uint8x8_t four = vdup_n_u8(4);
+
+	for (int r = 0; r < 8; r++) {
+		uint8x8_t plane0 = vtst_u8(vdup_n_u8(pattern[r]), bits);
+		uint8x8_t plane1 = vtst_u8(vdup_n_u8(pattern[r + 8]), bits);
+		vst1_u8(rows + r * 8, vorr_u8(vand_u8(plane0, two), vand_u8(plane1, four)));
+	}
+}
+#endif
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Runtime selection
+
+static void resolvePalette_Select(uint16* dest, const uint8* src, const uint16* palette, int count);
+static void decodeTile_Select(const uint8* pattern, uint8* rows);
+
+typedef void (*ResolvePaletteFunc)(uint16*, const uint8*, const uint16*, int);
+typedef void (*DecodeTileFunc)(const uint8*, uint8*);
+
+// machines on several threads can make the first call at once, so the pick is made once under pthread_once. Until then
+// the pointers lead to the trampolines below, afterwards they are only read (relaxed loads are plain loads)
+static std::atomic<ResolvePaletteFunc> resolvePaletteFunc(resolvePalette_Select);
+static std::atomic<DecodeTileFunc> decodeTileFunc(decodeTile_Select);
+static const char* simdName = "scalar";
+static pthread_once_t selectOnce = PTHREAD_ONCE_INIT;
+
+static bool allowKernel(const char* forced, const char* name) {
+	return forced == nullptr || strcmp(forced, name) == 0;
+}
+
+static void selectKernels() {
+	const char* forced = getenv("NESIZM_SIMD");
+	if (forced && !forced[0]) {
+		forced = nullptr;
+	}
+
+	ResolvePaletteFunc resolvePalette = resolvePalette_Scalar;
+	DecodeTileFunc decodeTile = decodeTile_Scalar;
+	simdName = "scalar";
+
+#if SIMD_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2") && allowKernel(forced, "avx2")) {
+		resolvePalette = resolvePalette_AVX2;
+		decodeTile = decodeTile_SSSE3;
+		simdName = "avx2";
+	} else if (__builtin_cpu_supports("ssse3") && (allowKernel(forced, "ssse3") || allowKernel(forced, "avx2"))) {
+		resolvePalette = resolvePalette_SSSE3;
+		decodeTile = decodeTile_SSSE3;
+		simdName = "ssse3";
+	}
+#elif SIMD_NEON
+	// NEON is part of the AArch64 baseline
+	if (allowKernel(forced, "neon")) {
+		resolvePalette = resolvePalette_NEON;
+		decodeTile = decodeTile_NEON;
+		simdName = "neon";
+	}
+#endif
+
+	resolvePaletteFunc.store(resolvePalette, std::memory_order_relaxed);
+	decodeTileFunc.store(decodeTile, std::memory_order_relaxed);
+}
+
+static void resolvePalette_Select(uint16* dest, const uint8* src, const uint16* palette, int count) {
+	pthread_once(&selectOnce, selectKernels);
+	resolvePaletteFunc.load(std::memory_order_relaxed)(dest, src, palette, count);
+}
+
+static void decodeTile_Select(const uint8* pattern, uint8* rows) {
+	pthread_once(&selectOnce, selectKernels);
+	decodeTileFunc.load(std::memory_order_relaxed)(pattern, rows);
+}
+
+void Host_ResolvePalette(uint16* dest, const uint8* src, const uint16* palette, int count) {
+	resolvePaletteFunc.load(std::memory_order_relaxed)(dest, src, palette, count);
+}
+
+void Host_DecodeTile(const uint8* pattern, uint8* rows) {
+	decodeTileFunc.load(std::memory_order_relaxed)(pattern, rows);
+}
+
+const char* Host_GetSIMDName() {
+	pthread_once(&selectOnce, selectKernels);
+	return simdName;
+}
+
+#endif
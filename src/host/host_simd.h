@@ -0,0 +1,13 @@
+// Vectorized pixel kernels for host builds, picked at runtime from what the CPU supports (TARGET_HOST only)
+#pragma once
+
+#include "platform.h"
+
+// resolves count scanline buffer bytes (palette entry * 2) to 16 bit colors through the 32 entry working palette
+void Host_ResolvePalette(uint16* dest, const uint8* src, const uint16* palette, int count);
+
+// decodes an 8x8 tile (16 bytes of bit planes) to 8 rows of 8 palette index bytes (0, 2, 4 or 6) in pixel order
+void Host_DecodeTile(const uint8* pattern, uint8* rows);
+
+// name of the kernel set in use (the NESIZM_SIMD environment variable can force scalar, ssse3, avx2 or neon)
+const char* Host_GetSIMDName();
@@ -0,0 +1,60 @@
+// Lock-free single producer, single consumer queue of fixed size slots, all allocated up front
+#pragma once
+
+#include "platform.h"
+#include "debug.h"
+
+#include <atomic>
+
+struct host_spsc_queue {
+	uint8* slots;
+	int32 slotSize;
+	uint32 numSlots;		// power of two
+
+	// the indices only count up, each is written by one side only and sits on its own cache line
+	alignas(64) std::atomic<uint32> head;		// next slot to pop, owned by the consumer
+	alignas(64) std::atomic<uint32> tail;		// next slot to push, owned by the producer
+
+	bool init(int32 withSlotSize, uint32 withNumSlots) {
+		DebugAssert(withNumSlots && (withNumSlots & (withNumSlots - 1)) == 0);
+		slots = (uint8*) malloc((size_t) withSlotSize * withNumSlots);
+		slotSize = withSlotSize;
+		numSlots = withNumSlots;
+		head.store(0, std::memory_order_relaxed);
+		tail.store(0, std::memory_order_relaxed);
+		return slots != nullptr;
+	}
+
+	void destroy() {
+		free(slots);
+		slots = nullptr;
+	}
+
+	// producer : the slot to fill, nullptr when the consumer is a whole queue behind
+	uint8* beginPush() {
+		const uint32 at = tail.load(std::memory_order_relaxed);
+		if (at - head.load(std::memory_order_acquire) == numSlots) {
+			return nullptr;
+		}
+		return slots + (size_t) (at & (numSlots - 1)) * slotSize;
+	}
+
+	// producer : hands the slot from beginPush to the consumer
+	void endPush() {
+		tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+
+	// consumer : the oldest filled slot, nullptr when empty
+	uint8* beginPop() {
+		const uint32 at = head.load(std::memory_order_relaxed);
+		if (at == tail.load(std::memory_order_acquire)) {
+			return nullptr;
+		}
+		return slots + (size_t) (at & (numSlots - 1)) * slotSize;
+	}
+
+	// consumer : gives the slot from beginPop back to the producer
+	void endPop() {
+		head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+};
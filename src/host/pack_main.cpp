@@ -0,0 +1,134 @@
+// nesizm-pack : converts an iNES ROM to the compressed .nz7 container, with each 8 KB of ROM data ZX7 compressed
+// separately so the cart can decompress just the bank it needs
+
+#if TARGET_HOST
+
+#include "platform.h"
+#include "debug.h"
+#include "nes.h"
+#include "zx7/zx7.h"
+#include "zx7_checked.h"
+
+static void PrintUsage() {
+	printf("usage: nesizm-pack <rom.nes> <rom.nz7>");
+}
+
+static void WriteBigEndian32(unsigned char* data, uint32 value) {
+	data[0] = value >> 24;
+	data[1] = value >> 16;
+	data[2] = value >> 8;
+	data[3] = value;
+}
+
+int main(int argc, char** argv) {
+	if (argc != 3) {
+		PrintUsage();
+		return 1;
+	}
+
+	FILE* file = fopen(argv[1], "rb");
+	if (!file) {
+		printf("Could not open %s", argv[1]);
+		return 1;
+	}
+
+	fseek(file, 0, SEEK_END);
+	int fileSize = ftell(file);
+	fseek(file, 0, SEEK_SET);
+
+	unsigned char* rom = (unsigned char*) malloc(fileSize > 0 ? fileSize : 1);
+	bool bRead = fileSize > 16 && fread(rom, 1, fileSize, file) == (size_t) fileSize;
+	fclose(file);
+
+	const unsigned char type[4] = { 0x4E, 0x45, 0x53, 0x1A };
+	if (!bRead || memcmp(rom, type, 4)) {
+		printf("Not an iNES ROM file format.");
+		free(rom);
+		return 1;
+	}
+
+	const int dataSize = fileSize - 16;
+	const int numChunks = (dataSize + 8191) / 8192;
+	const int tableSize = 4 * (numChunks + 1);
+
+	// worst case every chunk is stored with its 2 byte size
+	unsigned char* packed = (unsigned char*) malloc(NZ7_HEADER_SIZE + tableSize + numChunks * (8192 + 2));
+	memcpy(packed, "NZ7\x1A", 4);
+	memcpy(packed + 4, rom, 16);
+	WriteBigEndian32(packed + 20, dataSize);
+
+	int* chunkStart = (int*) malloc(numChunks * sizeof(int));
+	int packedSize = NZ7_HEADER_SIZE + tableSize;
+	for (int i = 0; i < numChunks; i++) {
+		WriteBigEndian32(packed + NZ7_HEADER_SIZE + 4 * i, packedSize);
+		chunkStart[i] = packedSize;
+
+		const unsigned char* chunk = rom + 16 + 8192 * i;
+		int chunkSize = dataSize - 8192 * i;
+		if (chunkSize > 8192) chunkSize = 8192;
+
+		// same block format as compressed images, 2 byte size (including itself) or 0 if stored uncompressed
+		unsigned char* compressed = nullptr;
+		uint32 compressedSize = ZX7Compress(chunk, chunkSize, &compressed);
+		unsigned char* target = packed + packedSize;
+		if (compressedSize > 0) {
+			compressedSize += 2;
+			target[0] = compressedSize >> 8;
+			target[1] = compressedSize & 0xFF;
+			memcpy(target + 2, compressed, compressedSize - 2);
+			packedSize += compressedSize;
+			free(compressed);
+		} else {
+			target[0] = 0;
+			target[1] = 0;
+			memcpy(target + 2, chunk, chunkSize);
+			packedSize += chunkSize + 2;
+		}
+	}
+	WriteBigEndian32(packed + NZ7_HEADER_SIZE + 4 * numChunks, packedSize);
+
+	// check every chunk round trips before writing anything
+	unsigned char decoded[8192];
+	for (int i = 0; i < numChunks; i++) {
+		const unsigned char* target = packed + chunkStart[i];
+		int chunkSize = dataSize - 8192 * i;
+		if (chunkSize > 8192) chunkSize = 8192;
+
+		const int chunkPacked = (i + 1 < numChunks ? chunkStart[i + 1] : packedSize) - chunkStart[i];
+
+		bool bDecoded;
+		if (target[0] | target[1]) {
+			bDecoded = ZX7DecompressChecked(target + 2, chunkPacked - 2, decoded, chunkSize);
+		} else {
+			bDecoded = chunkPacked == chunkSize + 2;
+			memcpy(decoded, target + 2, chunkSize);
+		}
+
+		if (!bDecoded || memcmp(decoded, rom + 16 + 8192 * i, chunkSize)) {
+			printf("Chunk %d did not decompress correctly", i);
+			free(chunkStart);
+			free(packed);
+			free(rom);
+			return 1;
+		}
+	}
+
+	file = fopen(argv[2], "wb");
+	bool bWritten = file && fwrite(packed, 1, packedSize, file) == (size_t) packedSize;
+	if (file) {
+		fclose(file);
+	}
+
+	if (bWritten) {
+		printf("%s : %d KB -> %d KB in %d chunks", argv[2], fileSize / 1024, packedSize / 1024, numChunks);
+	} else {
+		printf("Could not write %s", argv[2]);
+	}
+
+	free(chunkStart);
+	free(packed);
+	free(rom);
+	return bWritten ? 0 : 1;
+}
+
+#endif
@@ -0,0 +1,522 @@
+// nesizm-regress : parallel output check over a directory tree of ROMs
+//
+// Every .nes and .nz7 file under the given directory runs for a fixed number of frames with the same scripted input as
+// nesizm-bench (or its recorded movie with -movies), and each frame's screen and audio hashes are checked against the
+// nesizm-bench.txt in the ROM's own directory, written beforehand with nesizm-bench. ROMs are split between one worker
+// thread per core, each emulating its own machine, and a worker that runs out of ROMs takes them from the one with the
+// most left. Results can be written as JUnit XML for CI and as JSON.
+
+#if TARGET_HOST
+
+#include "platform.h"
+#include "debug.h"
+#include "nes.h"
+#include "settings.h"
+#include "snd/snd.h"
+#include "host_runner.h"
+#include "host_bench.h"
+
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+enum RegressStatus {
+	RS_OK,
+	RS_CHANGED,
+	RS_NO_BASELINE,
+	RS_LOAD_FAILED,
+	RS_NO_MOVIE,				// -movies, but the ROM has no movie that plays
+	RS_COUNT,
+};
+
+static const char* statusNames[] = { "ok", "changed", "no baseline", "load failed", "no movie" };
+
+struct regress_rom {
+	char path[256];				// relative to the ROM directory
+	const char* name;			// file name within path, as listed in the manifest
+	int32 manifest;				// index into manifests
+	RegressStatus status;
+	int32 mapper;
+	double seconds;
+	int32 divergentFrame;		// first frame that differs from the manifest, -1 if none
+	bool videoDiverged;
+	bool audioDiverged;			// both false with a divergent frame when the manifest has no hashes for it
+	int32 worker;				// thread that ran it
+};
+
+struct regress_manifest {
+	char dir[256];
+	bench_manifest hashes;
+};
+
+// each worker's share of the ROM list, taken from the front by its owner and from the back by other workers
+struct regress_queue {
+	pthread_mutex_t lock;
+	int32 head;
+	int32 tail;
+	int32 steals;				// ROMs this worker took from others
+};
+
+static const int32 MAX_ROMS = 4096;
+static const int32 MAX_MANIFESTS = 256;
+static const int32 MAX_THREADS = 64;
+
+static regress_rom roms[MAX_ROMS];
+static int32 numROMs = 0;
+static regress_manifest manifests[MAX_MANIFESTS];
+static int32 numManifests = 0;
+static regress_queue queues[MAX_THREADS];
+static int32 numThreads = 0;
+
+static char romRoot[256];
+static int32 numFrames = 1800;
+static bool bPlayMovies = false;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// ROM discovery
+
+static void FindROMs(const char* subDir) {
+	char dirPath[512];
+	snprintf(dirPath, sizeof(dirPath), "%s%s%s", romRoot, subDir[0] ? "/" : "", subDir);
+	DIR* dir = opendir(dirPath);
+	if (!dir) {
+		return;
+	}
+
+	int32 manifest = -1;
+	while (struct dirent* entry = readdir(dir)) {
+		if (entry->d_name[0] == '.') {
+			continue;
+		}
+
+		char path[256];
+		if (snprintf(path, sizeof(path), "%s%s%s", subDir, subDir[0] ? "/" : "", entry->d_name) >= (int) sizeof(path)) {
+			printf("Path too long, skipped: %s", entry->d_name);
+			continue;
+		}
+
+		// some file systems leave the type out of the listing, so it is looked up
+		bool bDir = entry->d_type == DT_DIR;
+		if (entry->d_type == DT_UNKNOWN) {
+			char fullPath[800];
+			snprintf(fullPath, sizeof(fullPath), "%s/%s", dirPath, entry->d_name);
+			struct stat info;
+			bDir = stat(fullPath, &info) == 0 && S_ISDIR(info.st_mode);
+		}
+
+		if (bDir) {
+			FindROMs(path);
+			continue;
+		}
+
+		const char* ext = strrchr(entry->d_name, '.');
+		if (!ext || (strcasecmp(ext, ".nes") != 0 && strcasecmp(ext, ".nz7") != 0)) {
+			continue;
+		}
+		if (strlen(entry->d_name) >= 64 || numROMs == MAX_ROMS) {
+			printf("Skipped %s", path);
+			continue;
+		}
+
+		// one manifest per directory, loaded when its first ROM turns up
+		if (manifest == -1) {
+			if (numManifests == MAX_MANIFESTS) {
+				printf("Too many ROM directories, skipped %s", dirPath);
+				break;
+			}
+			manifest = numManifests++;
+			strcpy(manifests[manifest].dir, subDir);
+
+			char manifestPath[600];
+			snprintf(manifestPath, sizeof(manifestPath), "%s/nesizm-bench.txt", dirPath);
+			manifests[manifest].hashes.load(manifestPath);
+		}
+
+		regress_rom& rom = roms[numROMs++];
+		strcpy(rom.path, path);
+		rom.manifest = manifest;
+	}
+	closedir(dir);
+}
+
+static int CompareROMs(const void* a, const void* b) {
+	return strcmp(((const regress_rom*) a)->path, ((const regress_rom*) b)->path);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Work stealing
+
+// next ROM for the worker, -1 once every queue is empty
+static int32 NextROM(int32 worker) {
+	regress_queue& own = queues[worker];
+	pthread_mutex_lock(&own.lock);
+	int32 index = own.head < own.tail ? own.head++ : -1;
+	pthread_mutex_unlock(&own.lock);
+	if (index != -1) {
+		return index;
+	}
+
+	// steal from the back of the fullest queue, the ROMs furthest from what its owner is running
+	for (;;) {
+		int32 victim = -1;
+		int32 mostLeft = 0;
+		for (int32 i = 0; i < numThreads; i++) {
+			pthread_mutex_lock(&queues[i].lock);
+			const int32 left = queues[i].tail - queues[i].head;
+			pthread_mutex_unlock(&queues[i].lock);
+			if (left > mostLeft) {
+				victim = i;
+				mostLeft = left;
+			}
+		}
+		if (victim == -1) {
+			return -1;
+		}
+
+		// another worker may have emptied it since, in which case look again
+		pthread_mutex_lock(&queues[victim].lock);
+		index = queues[victim].head < queues[victim].tail ? --queues[victim].tail : -1;
+		pthread_mutex_unlock(&queues[victim].lock);
+		if (index != -1) {
+			own.steals++;
+			return index;
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Running
+
+static void RunROM(regress_rom& rom) {
+	const bench_manifest& manifest = manifests[rom.manifest].hashes;
+	int32 hint = 0;
+	const bool hasBaseline = manifest.find(rom.name, 0, hint) != nullptr;
+	rom.divergentFrame = -1;
+
+	char romPath[512];
+	snprintf(romPath, sizeof(romPath), "%s/%s", romRoot, rom.path);
+	if (!Host_LoadROM(romPath)) {
+		rom.status = RS_LOAD_FAILED;
+		return;
+	}
+	rom.mapper = nesCart.mapper;
+
+	// movies start from power on, before the first frame
+	if (bPlayMovies && !nesMovie.StartPlayback()) {
+		Host_UnloadROM();
+		rom.status = RS_NO_MOVIE;
+		return;
+	}
+
+	const int32 samplesPerFrame = SOUND_RATE / (nesCart.isPAL ? 50 : 60);
+	int* audio = (int*) malloc(samplesPerFrame * sizeof(int));
+
+	for (int32 frame = 0; frame < numFrames; frame++) {
+		if (!bPlayMovies) {
+			Bench_ApplyScriptedInput(frame);
+		}
+
+		const double startTime = Host_GetSeconds();
+		Host_RunFrames(1);
+		const bool mixed = Host_MixSound(audio, samplesPerFrame);
+		rom.seconds += Host_GetSeconds() - startTime;
+
+		if (!hasBaseline || rom.divergentFrame != -1) {
+			continue;
+		}
+
+		const uint32 videoHash = Bench_HashVideo();
+		const uint32 audioHash = mixed ? Bench_HashBytes(2166136261u, audio, samplesPerFrame * sizeof(int)) : 0;
+		const bench_frame_hash* expected = manifest.find(rom.name, frame, hint);
+		if (!expected || expected->video != videoHash || expected->audio != audioHash) {
+			rom.divergentFrame = frame;
+			rom.videoDiverged = expected && expected->video != videoHash;
+			rom.audioDiverged = expected && expected->audio != audioHash;
+		}
+	}
+
+	free(audio);
+	Host_UnloadROM();
+
+	if (!hasBaseline) {
+		rom.status = RS_NO_BASELINE;
+	} else if (rom.divergentFrame != -1) {
+		rom.status = RS_CHANGED;
+	} else {
+		rom.status = RS_OK;
+	}
+}
+
+static void* RegressWorker(void* param) {
+	const int32 worker = (int32) (intptr_t) param;
+
+	// settings are per machine, so each worker sets up its own (same fixed settings as nesizm-bench)
+	nesSettings.Load();
+	nesSettings.SetSetting(ST_FrameSkip, 1);
+	nesSettings.SetSetting(ST_ShowClock, 0);
+	nesSettings.SetSetting(ST_ShowFPS, 0);
+	nesSettings.SetSetting(ST_SoundEnabled, 1);
+	nesSettings.SetSetting(ST_RunAhead, 0);
+
+	for (int32 index = NextROM(worker); index != -1; index = NextROM(worker)) {
+		roms[index].worker = worker;
+		RunROM(roms[index]);
+	}
+	return nullptr;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Reports
+
+static double GetFPS(const regress_rom& rom) {
+	return rom.seconds > 0 ? numFrames / rom.seconds : 0.0;
+}
+
+static const char* GetDivergence(const regress_rom& rom) {
+	if (rom.divergentFrame == -1) {
+		return "";
+	}
+	if (rom.videoDiverged) {
+		return rom.audioDiverged ? "video and audio" : "video";
+	}
+	return rom.audioDiverged ? "audio" : "no baseline hashes";
+}
+
+static void WriteEscaped(FILE* file, const char* text, bool bXML) {
+	for (; *text; text++) {
+		const unsigned char c = *text;
+		if (bXML && c == '&') {
+			fputs("&amp;", file);
+		} else if (bXML && c == '<') {
+			fputs("&lt;", file);
+		} else if (bXML && c == '>') {
+			fputs("&gt;", file);
+		} else if (bXML && c == '"') {
+			fputs("&quot;", file);
+		} else if (!bXML && (c == '"' || c == '\\')) {
+			fprintf(file, "\\%c", c);
+		} else if (c < 0x20) {
+			fprintf(file, bXML ? "&#%d;" : "\\u%04x", c);
+		} else {
+			fputc(c, file);
+		}
+	}
+}
+
+static bool WriteJUnit(const char* path, const int32* counts, double wallSeconds) {
+	FILE* file = fopen(path, "w");
+	if (!file) {
+		return false;
+	}
+
+	fprintf(file, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+	fprintf(file, "<testsuites name=\"nesizm-regress\" tests=\"%d\" failures=\"%d\" errors=\"%d\" skipped=\"%d\" time=\"%.3f\">\n",
+		numROMs, counts[RS_CHANGED], counts[RS_LOAD_FAILED] + counts[RS_NO_MOVIE], counts[RS_NO_BASELINE], wallSeconds);
+	fprintf(file, "  <testsuite name=\"nesizm-regress\" tests=\"%d\" failures=\"%d\" errors=\"%d\" skipped=\"%d\" time=\"%.3f\">\n",
+		numROMs, counts[RS_CHANGED], counts[RS_LOAD_FAILED] + counts[RS_NO_MOVIE], counts[RS_NO_BASELINE], wallSeconds);
+	fprintf(file, "    <properties>\n");
+	fprintf(file, "      <property name=\"frames\" value=\"%d\"/>\n", numFrames);
+	fprintf(file, "      <property name=\"threads\" value=\"%d\"/>\n", numThreads);
+	fprintf(file, "      <property name=\"input\" value=\"%s\"/>\n", bPlayMovies ? "movies" : "script");
+	fprintf(file, "    </properties>\n");
+
+	for (int32 i = 0; i < numROMs; i++) {
+		const regress_rom& rom = roms[i];
+
+		// grouped by mapper so CI shows which mappers regressed
+		fprintf(file, "    <testcase classname=\"mapper%d\" name=\"", rom.mapper);
+		WriteEscaped(file, rom.path, true);
+		fprintf(file, "\" time=\"%.3f\">\n", rom.seconds);
+		fprintf(file, "      <properties>\n");
+		fprintf(file, "        <property name=\"mapper\" value=\"%d\"/>\n", rom.mapper);
+		fprintf(file, "        <property name=\"fps\" value=\"%.1f\"/>\n", GetFPS(rom));
+		fprintf(file, "        <property name=\"firstDivergentFrame\" value=\"%d\"/>\n", rom.divergentFrame);
+		fprintf(file, "        <property name=\"worker\" value=\"%d\"/>\n", rom.worker);
+		fprintf(file, "      </properties>\n");
+		if (rom.status == RS_CHANGED) {
+			fprintf(file, "      <failure type=\"changed\" message=\"output changed at frame %d (%s)\"/>\n", rom.divergentFrame, GetDivergence(rom));
+		} else if (rom.status == RS_LOAD_FAILED) {
+			fprintf(file, "      <error type=\"load failed\" message=\"could not load ROM\"/>\n");
+		} else if (rom.status == RS_NO_MOVIE) {
+			fprintf(file, "      <error type=\"no movie\" message=\"no movie for this ROM could be played (record one with nesizm-bench -record)\"/>\n");
+		} else if (rom.status == RS_NO_BASELINE) {
+			fprintf(file, "      <skipped message=\"no hashes in nesizm-bench.txt (record them with nesizm-bench)\"/>\n");
+		}
+		fprintf(file, "    </testcase>\n");
+	}
+
+	fprintf(file, "  </testsuite>\n");
+	fprintf(file, "</testsuites>\n");
+	fclose(file);
+	return true;
+}
+
+static bool WriteJSON(const char* path, const int32* counts, double wallSeconds) {
+	FILE* file = fopen(path, "w");
+	if (!file) {
+		return false;
+	}
+
+	fprintf(file, "{\n");
+	fprintf(file, "  \"frames\": %d,\n", numFrames);
+	fprintf(file, "  \"threads\": %d,\n", numThreads);
+	fprintf(file, "  \"input\": \"%s\",\n", bPlayMovies ? "movies" : "script");
+	fprintf(file, "  \"seconds\": %.3f,\n", wallSeconds);
+	fprintf(file, "  \"passed\": %d,\n", counts[RS_OK]);
+	fprintf(file, "  \"changed\": %d,\n", counts[RS_CHANGED]);
+	fprintf(file, "  \"noBaseline\": %d,\n", counts[RS_NO_BASELINE]);
+	fprintf(file, "  \"loadFailed\": %d,\n", counts[RS_LOAD_FAILED]);
+	fprintf(file, "  \"noMovie\": %d,\n", counts[RS_NO_MOVIE]);
+	fprintf(file, "  \"roms\": [");
+
+	for (int32 i = 0; i < numROMs; i++) {
+		const regress_rom& rom = roms[i];
+		fprintf(file, "%s\n    {\"rom\": \"", i ? "," : "");
+		WriteEscaped(file, rom.path, false);
+		fprintf(file, "\", \"mapper\": %d, \"status\": \"%s\", \"fps\": %.1f, \"seconds\": %.3f, \"firstDivergentFrame\": %d, \"divergence\": \"%s\", \"worker\": %d}",
+			rom.mapper, statusNames[rom.status], GetFPS(rom), rom.seconds, rom.divergentFrame, GetDivergence(rom), rom.worker);
+	}
+
+	fprintf(file, "\n  ]\n}\n");
+	fclose(file);
+	return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static void PrintUsage() {
+	printf("usage: nesizm-regress <rom dir> [-frames N] [-threads N] [-movies] [-junit file] [-json file]");
+}
+
+int main(int argc, char** argv) {
+	if (argc < 2) {
+		PrintUsage();
+		return 1;
+	}
+
+	strncpy(romRoot, argv[1], sizeof(romRoot) - 1);
+	for (int32 len = strlen(romRoot); len > 1 && romRoot[len - 1] == '/'; len--) {
+		romRoot[len - 1] = 0;
+	}
+
+	const char* junitPath = nullptr;
+	const char* jsonPath = nullptr;
+	numThreads = sysconf(_SC_NPROCESSORS_ONLN);
+
+	for (int i = 2; i < argc; i++) {
+		if (!strcmp(argv[i], "-frames") && i + 1 < argc) {
+			numFrames = atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "-threads") && i + 1 < argc) {
+			numThreads = atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "-movies")) {
+			bPlayMovies = true;
+		} else if (!strcmp(argv[i], "-junit") && i + 1 < argc) {
+			junitPath = argv[++i];
+		} else if (!strcmp(argv[i], "-json") && i + 1 < argc) {
+			jsonPath = argv[++i];
+		} else {
+			PrintUsage();
+			return 1;
+		}
+	}
+
+	if (numFrames <= 0 || numThreads <= 0) {
+		PrintUsage();
+		return 1;
+	}
+
+	// gather ROMs in a stable order, so shares and reports don't depend on directory order
+	FindROMs("");
+	if (numROMs == 0) {
+		printf("No .nes or .nz7 files found in %s", romRoot);
+		return 1;
+	}
+	qsort(roms, numROMs, sizeof(regress_rom), CompareROMs);
+	for (int32 i = 0; i < numROMs; i++) {
+		roms[i].name = strrchr(roms[i].path, '/') ? strrchr(roms[i].path, '/') + 1 : roms[i].path;
+	}
+
+	numThreads = min(numThreads, min(numROMs, MAX_THREADS));
+
+	// neighbouring ROMs tend to share a directory and mapper, so each worker starts with a contiguous share
+	for (int32 i = 0; i < numThreads; i++) {
+		pthread_mutex_init(&queues[i].lock, nullptr);
+		queues[i].head = numROMs * i / numThreads;
+		queues[i].tail = numROMs * (i + 1) / numThreads;
+	}
+
+	const double startTime = Host_GetSeconds();
+
+	pthread_t threads[MAX_THREADS];
+	for (int32 i = 0; i < numThreads; i++) {
+		if (pthread_create(&threads[i], nullptr, RegressWorker, (void*) (intptr_t) i) != 0) {
+			printf("Could not start worker thread");
+			return 1;
+		}
+	}
+	for (int32 i = 0; i < numThreads; i++) {
+		pthread_join(threads[i], nullptr);
+	}
+
+	const double wallSeconds = Host_GetSeconds() - startTime;
+
+	int32 counts[RS_COUNT] = { 0 };
+	double romSeconds = 0;
+	printf("%s", "");
+	printf("%-48.48s %6s %8s  %s", "ROM", "Mapper", "FPS", "Output");
+	for (int32 i = 0; i < numROMs; i++) {
+		const regress_rom& rom = roms[i];
+		counts[rom.status]++;
+		romSeconds += rom.seconds;
+
+		char status[64];
+		if (rom.status == RS_CHANGED) {
+			sprintf(status, "CHANGED at frame %d (%s)", rom.divergentFrame, GetDivergence(rom));
+		} else if (rom.status == RS_NO_BASELINE) {
+			strcpy(status, "no baseline (record with nesizm-bench)");
+		} else if (rom.status == RS_LOAD_FAILED) {
+			strcpy(status, "LOAD FAILED");
+		} else if (rom.status == RS_NO_MOVIE) {
+			strcpy(status, "NO MOVIE (record with nesizm-bench -record)");
+		} else {
+			strcpy(status, "ok");
+		}
+
+		if (rom.status == RS_LOAD_FAILED) {
+			printf("%-48.48s %6s %8s  %s", rom.path, "-", "-", status);
+		} else {
+			printf("%-48.48s %6d %8.1f  %s", rom.path, rom.mapper, GetFPS(rom), status);
+		}
+	}
+
+	int32 steals = 0;
+	for (int32 i = 0; i < numThreads; i++) {
+		steals += queues[i].steals;
+		pthread_mutex_destroy(&queues[i].lock);
+	}
+
+	printf("%s", "");
+	printf("%d ROMs: %d ok, %d changed, %d without baseline, %d failed to load, %d without movie", numROMs, counts[RS_OK],
+		counts[RS_CHANGED], counts[RS_NO_BASELINE], counts[RS_LOAD_FAILED], counts[RS_NO_MOVIE]);
+	printf("%.2f s on %d threads (%.2f s of emulation, %.1fx), %d ROMs stolen", wallSeconds, numThreads, romSeconds,
+		wallSeconds > 0 ? romSeconds / wallSeconds : 0.0, steals);
+
+	bool bFailed = counts[RS_CHANGED] || counts[RS_LOAD_FAILED] || counts[RS_NO_MOVIE];
+	if (junitPath && !WriteJUnit(junitPath, counts, wallSeconds)) {
+		printf("Could not write %s", junitPath);
+		bFailed = true;
+	}
+	if (jsonPath && !WriteJSON(jsonPath, counts, wallSeconds)) {
+		printf("Could not write %s", jsonPath);
+		bFailed = true;
+	}
+
+	if (bFailed) {
+		printf("FAILED: output changed or ROMs failed to load or play their movies");
+	}
+
+	return bFailed ? 1 : 0;
+}
+
+#endif
@@ -0,0 +1,19 @@
+// Host version of the sound library interface. There is no audio device on host, the
+// mixer is only driven when the host asks for samples with Host_MixSound
+#pragma once
+
+#define SOUND_RATE 44100
+
+// implemented by the emulator, fills buffer with length samples
+void sndFrame(int* buffer, int length);
+
+void sndInit();
+void sndCleanup();
+void sndVolumeUp();
+void sndVolumeDown();
+
+// called regularly by the core so that the device can keep its buffers topped up
+inline void condSoundUpdate() {}
+
+// mixes the given number of samples through sndFrame (no-op if sound was never initialized)
+bool Host_MixSound(int* buffer, int length);
@@ -0,0 +1,180 @@
+// Host implementation of ZX7 compression, matches the stream the SDK zx7 library decompresses on the calculator
+
+#if TARGET_HOST
+
+#include "platform.h"
+#include "debug.h"
+#include "zx7.h"
+
+// matches can reach back 2176 bytes, offsets below 128 take one byte and the rest one byte and 4 bits
+#define ZX7_MAX_OFFSET 2176
+#define ZX7_SHORT_OFFSET 128
+#define ZX7_MAX_LENGTH 65536
+
+struct zx7_writer {
+	unsigned char* out;
+	int pos;
+	int bitPos;
+	int bitMask;
+
+	void writeByte(int value) {
+		out[pos++] = value;
+	}
+
+	// bits are packed into a byte reserved at the point the first of them is written
+	void writeBit(int value) {
+		if (bitMask == 0) {
+			bitMask = 128;
+			bitPos = pos;
+			out[pos++] = 0;
+		}
+		if (value) {
+			out[bitPos] |= bitMask;
+		}
+		bitMask >>= 1;
+	}
+
+	void writeEliasGamma(int value) {
+		int bit = 2;
+		for (; bit <= value; bit <<= 1) {
+			writeBit(0);
+		}
+		while ((bit >>= 1) > 0) {
+			writeBit(value & bit);
+		}
+	}
+};
+
+static int EliasGammaBits(int value) {
+	int bits = 1;
+	while (value > 1) {
+		bits += 2;
+		value >>= 1;
+	}
+	return bits;
+}
+
+unsigned int ZX7Compress(const unsigned char* src, unsigned int size, unsigned char** outData) {
+	*outData = nullptr;
+	if (size < 2) {
+		return 0;
+	}
+
+	// cost[i] is the fewest bits that encode the first i bytes, ending with a literal or a match of matchLength[i]
+	uint32* cost = (uint32*) malloc((size + 1) * sizeof(uint32));
+	int32* matchLength = (int32*) malloc((size + 1) * sizeof(int32));
+	int32* matchOffset = (int32*) malloc((size + 1) * sizeof(int32));
+
+	// length of the run of equal bytes ending at the current position for each offset
+	int32* run = (int32*) calloc(ZX7_MAX_OFFSET + 1, sizeof(int32));
+
+	cost[1] = 8;
+	matchLength[1] = 0;
+	for (uint32 i = 2; i <= size; i++) {
+		cost[i] = cost[i - 1] + 9;
+		matchLength[i] = 0;
+
+		// longest match with a short and with a long offset that ends at byte i - 1, never reaching byte 0
+		int32 bestShort = 0, bestShortOffset = 0;
+		int32 bestLong = 0, bestLongOffset = 0;
+		const int32 maxOffset = i - 1 < ZX7_MAX_OFFSET ? i - 1 : ZX7_MAX_OFFSET;
+		for (int32 offset = 1; offset <= maxOffset; offset++) {
+			if (src[i - 1] == src[i - 1 - offset]) {
+				run[offset]++;
+			} else {
+				run[offset] = 0;
+			}
+
+			int32 length = run[offset];
+			if (length > int32(i) - 1) length = i - 1;
+			if (length > ZX7_MAX_LENGTH) length = ZX7_MAX_LENGTH;
+
+			if (offset <= ZX7_SHORT_OFFSET) {
+				if (length > bestShort) {
+					bestShort = length;
+					bestShortOffset = offset;
+				}
+			} else if (length > bestLong) {
+				bestLong = length;
+				bestLongOffset = offset;
+			}
+		}
+
+		// every length up to the longest match is possible, short offsets are used while they reach
+		const int32 longest = bestShort > bestLong ? bestShort : bestLong;
+		for (int32 length = 2; length <= longest; length++) {
+			const bool bShort = length <= bestShort;
+			uint32 bits = cost[i - length] + 1 + EliasGammaBits(length - 1) + (bShort ? 8 : 12);
+			if (bits < cost[i]) {
+				cost[i] = bits;
+				matchLength[i] = length;
+				matchOffset[i] = bShort ? bestShortOffset : bestLongOffset;
+			}
+		}
+	}
+	free(run);
+
+	// 18 bits of end marker, then round up to bytes
+	uint32 totalSize = (cost[size] + 18 + 7) / 8;
+	if (totalSize >= size) {
+		free(cost);
+		free(matchLength);
+		free(matchOffset);
+		return 0;
+	}
+
+	// walk the parse backwards to flag where each match ends, so it can be written forwards
+	for (uint32 i = size; i > 1; ) {
+		uint32 length = matchLength[i] ? matchLength[i] : 1;
+		cost[i - length] = i;
+		i -= length;
+	}
+
+	zx7_writer writer;
+	writer.out = (unsigned char*) malloc(totalSize);
+	writer.pos = 0;
+	writer.bitPos = 0;
+	writer.bitMask = 0;
+
+	writer.writeByte(src[0]);
+	for (uint32 i = 1; i < size; ) {
+		uint32 next = cost[i];
+		if (matchLength[next] == 0) {
+			writer.writeBit(0);
+			writer.writeByte(src[i]);
+		} else {
+			writer.writeBit(1);
+			writer.writeEliasGamma(matchLength[next] - 1);
+
+			int32 offset = matchOffset[next] - 1;
+			if (offset < ZX7_SHORT_OFFSET) {
+				writer.writeByte(offset);
+			} else {
+				offset -= ZX7_SHORT_OFFSET;
+				writer.writeByte((offset & 127) | 128);
+				for (int32 mask = 1024; mask > 127; mask >>= 1) {
+					writer.writeBit(offset & mask);
+				}
+			}
+		}
+		i = next;
+	}
+
+	// end marker is a match with a 17 bit gamma length
+	writer.writeBit(1);
+	for (int i = 0; i < 16; i++) {
+		writer.writeBit(0);
+	}
+	writer.writeBit(1);
+
+	DebugAssert(uint32(writer.pos) == totalSize);
+
+	free(cost);
+	free(matchLength);
+	free(matchOffset);
+
+	*outData = writer.out;
+	return writer.pos;
+}
+
+#endif
@@ -0,0 +1,5 @@
+// Host stand in for the SDK zx7 library (ZX7 format by Einar Saukas), used by the compressed ROM container (TARGET_HOST only)
+#pragma once
+
+// compresses size bytes with an optimal parse into a malloced buffer, returns compressed size or 0 if it would not be smaller
+unsigned int ZX7Compress(const unsigned char* src, unsigned int size, unsigned char** outData);
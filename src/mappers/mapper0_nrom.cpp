@@ -8,7 +8,7 @@ void NROM_writeSpecial(unsigned int address, unsigned char value) {
 	if (address >= 0x6000) {
 		if (address < 0x8000 && nesCart.numRAMBanks) {
 			// RAM
-			mainCPU.writeDirect(address, value);
+			mainCPU.writeWRAM(address, value);
 		} else {
 			// does nothing!
 		}
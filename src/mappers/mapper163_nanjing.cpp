@@ -10,7 +10,7 @@ void Mapper163_writeSpecial(unsigned int address, unsigned char value) {
 	if (address >= 0x6000) {
 		if (address < 0x8000 && nesCart.numRAMBanks) {
 			// RAM
-			mainCPU.writeDirect(address, value);
+			mainCPU.writeWRAM(address, value);
 		} else {
 			// does nothing!
 		}
@@ -51,11 +51,11 @@ void nes_cart::Mapper163_ScanlineClock() {
 	if (Mapper163_REG[1] & 0x80) {
 		const int chrPage = nesCart.cachedBankCount + 1;
 		if (nesPPU.scanline == 240) {
-			nesPPU.chrPages[0] = nesCart.cache[chrPage].ptr;
-			nesPPU.chrPages[1] = nesCart.cache[chrPage].ptr;
+			nesPPU.setChrPages(0, 4, nesCart.cache[chrPage].ptr);
+			nesPPU.setChrPages(4, 4, nesCart.cache[chrPage].ptr);
 		} else if (nesPPU.scanline == 128) {
-			nesPPU.chrPages[0] = nesCart.cache[chrPage].ptr + 0x1000;
-			nesPPU.chrPages[1] = nesCart.cache[chrPage].ptr + 0x1000;
+			nesPPU.setChrPages(0, 4, nesCart.cache[chrPage].ptr + 0x1000);
+			nesPPU.setChrPages(4, 4, nesCart.cache[chrPage].ptr + 0x1000);
 		}
 	}
 }
@@ -75,8 +75,7 @@ void nes_cart::Mapper163_Update() {
 	// not using the chr flip mode
 	if ((Mapper163_REG[1] & 0x80) == 0) {
 		const int chrPage = cachedBankCount + 1;
-		nesPPU.chrPages[0] = cache[chrPage].ptr;
-		nesPPU.chrPages[1] = cache[chrPage].ptr + 0x1000;
+		nesPPU.setChrPages(0, 8, cache[chrPage].ptr);
 	}
 
 	// update protect page values
@@ -98,8 +97,7 @@ void nes_cart::setupMapper163_Nanjing() {
 	// these carts only use CHR RAM
 	DebugAssert(!numCHRBanks);
 	// chr map uses best bank for chr caching locality:
-	nesPPU.chrPages[0] = cache[chrPage].ptr;
-	nesPPU.chrPages[1] = cache[chrPage].ptr + 0x1000;
+	nesPPU.setChrPages(0, 8, cache[chrPage].ptr);
 
 	scanlineClock = nes_cart::Mapper163_ScanlineClock;
 	writeSpecial = Mapper163_writeSpecial;
@@ -9,7 +9,7 @@ void MMC1_writeSpecial(unsigned int address, unsigned char value) {
 			// if enabled and available
 			if (nesCart.numRAMBanks && MMC1_RAM_DISABLE == 0) {
 				// RAM
-				mainCPU.writeDirect(address, value);
+				mainCPU.writeWRAM(address, value);
 			} 
 		} else {
 			if (value & 0x80) {
@@ -198,8 +198,7 @@ void nes_cart::setupMapper1_MMC1() {
 		cachedBankCount--;
 
 		// chr map uses best bank for chr caching locality:
-		nesPPU.chrPages[0] = cache[cachedBankCount].ptr;
-		nesPPU.chrPages[1] = cache[cachedBankCount].ptr + 0x1000;
+		nesPPU.setChrPages(0, 8, cache[cachedBankCount].ptr);
 	}
 
 	// RAM bank (first index if applicable) set up at 0x6000
@@ -8,7 +8,7 @@ void UNROM_writeSpecial(unsigned int address, unsigned char value) {
 		if (address < 0x8000) {
 			if (nesCart.numRAMBanks) {
 				// RAM
-				mainCPU.writeDirect(address, value);
+				mainCPU.writeWRAM(address, value);
 			}
 		} else {
 			// bank select
@@ -29,8 +29,7 @@ void nes_cart::setupMapper2_UNROM() {
 	if (numCHRBanks == 1) {
 		MapCharacterBanks(0, 0, 8);
 	} else {
-		nesPPU.chrPages[0] = cache[chrBank].ptr;
-		nesPPU.chrPages[1] = cache[chrBank].ptr + 0x1000;
+		nesPPU.setChrPages(0, 8, cache[chrBank].ptr);
 	}
 
 	// map first 16 KB of PRG mamory to 80-BF by default, and last 16 KB to C0-FF
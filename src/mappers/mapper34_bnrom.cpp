@@ -44,7 +44,7 @@ void BNROM_writeSpecial(unsigned int address, unsigned char value) {
 		if (address < 0x8000) {
 			if (nesCart.numRAMBanks) {
 				// RAM
-				mainCPU.writeDirect(address, value);
+				mainCPU.writeWRAM(address, value);
 			}
 		} else {
 			// bank select
@@ -67,8 +67,7 @@ void nes_cart::setupMapper34_BNROM() {
 	} else {
 		cachedBankCount--;
 		int chrBank = cachedBankCount;
-		nesPPU.chrPages[0] = cache[chrBank].ptr;
-		nesPPU.chrPages[1] = cache[chrBank].ptr + 0x1000;
+		nesPPU.setChrPages(0, 8, cache[chrBank].ptr);
 	}
 
 	// map first 32 KB of PRG mamory to 80-FF by default
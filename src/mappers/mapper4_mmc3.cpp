@@ -9,7 +9,7 @@ void MMC3_writeSpecial(unsigned int address, unsigned char value) {
 		if (address < 0x8000) {
 			if (nesCart.numRAMBanks) {
 				// RAM
-				mainCPU.writeDirect(address, value);
+				mainCPU.writeWRAM(address, value);
 			} else {
 				// open bus
 			}
@@ -185,42 +185,29 @@ void nes_cart::MMC3_ScanlineClock() {
 	const int OAM_LOOKUP_CYCLE = 82; // 82 is derived from: PPU clock 260 / 3 - half the largest instruction size, appears to get us compatible
 
 	if (nesPPU.PPUCTRL & PPUCTRL_SPRSIZE) {
-		// we need to build the fetch mask potentially
-		if (nesPPU.dirtyOAM) {
-			nesPPU.resolveOAMExternal();
-		}
+		// we need to build the sprite lists potentially
+		nesPPU.updateSpriteLines();
 
 		// 8x16 sprites are a special case
 		flipCycles = OAM_LOOKUP_CYCLE;
 
 		// check which sprites are on this scanline to determine irq decrement amount
 		irqDec = 0;
-		unsigned char* curObj = &nesPPU.oam[252];
 		int lastPatternTable = 0;
 		int numSprites = 0;
-		int scanlineOffset = nesPPU.scanline - 2;
 
-		extern uint8 fetchMask[272];
-		for (int b = fetchMask[nesPPU.scanline]; b; b = b >> 1) {
-			if (!(b & 1)) {
-				curObj -= 32;
-				continue;
+		const uint8* lineSprites = nesPPU.spriteLines.getSprites(nesPPU.scanline);
+		for (int s = nesPPU.spriteLines.count[nesPPU.scanline] - 1; s >= 0; s--) {
+			unsigned char* curObj = &nesPPU.oam[lineSprites[s]];
+			numSprites++;
+			int patternTable = (curObj[1] & 1);
+			if (patternTable > lastPatternTable) {
+				irqDec++;
 			}
+			lastPatternTable = patternTable;
 
-			for (int i = 0; i < 8; i++, curObj -= 4) {
-				unsigned int yCoord = scanlineOffset - curObj[0];
-				if (yCoord < 16) {
-					numSprites++;
-					int patternTable = (curObj[1] & 1);
-					if (patternTable > lastPatternTable) {
-						irqDec++;
-					}
-					lastPatternTable = patternTable;
-
-					if (numSprites == 8) {
-						break;
-					}
-				}
+			if (numSprites == 8) {
+				break;
 			}
 		}
 		if (numSprites < 8 && lastPatternTable == 0) {
@@ -8,7 +8,7 @@ void GXROM_writeSpecial(unsigned int address, unsigned char value) {
 		if (address < 0x8000 && nesCart.mapper != 140) {
 			if (nesCart.numRAMBanks) {
 				// RAM
-				mainCPU.writeDirect(address, value);
+				mainCPU.writeWRAM(address, value);
 			}
 		} else if (nesCart.mapper == 66 || address < 0x8000) {
 			// bank select
@@ -32,8 +32,7 @@ void nes_cart::setupMapper66_GXROM() {
 	} else {
 		cachedBankCount--;
 		int chrBank = cachedBankCount;
-		nesPPU.chrPages[0] = cache[chrBank].ptr;
-		nesPPU.chrPages[1] = cache[chrBank].ptr + 0x1000;
+		nesPPU.setChrPages(0, 8, cache[chrBank].ptr);
 	}
 
 	// map first 32 KB of PRG mamory to 80-FF by default
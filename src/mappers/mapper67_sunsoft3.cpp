@@ -33,7 +33,7 @@ void Mapper67_writeSpecial(unsigned int address, unsigned char value) {
 		if (address < 0x8000) {
 			if (nesCart.numRAMBanks) {
 				// RAM
-				mainCPU.writeDirect(address, value);
+				mainCPU.writeWRAM(address, value);
 			}
 		} else {
 			if ((address & 0x8800) == 0x8000) {
@@ -17,10 +17,13 @@ void nes_cart::Mapper68_Update(bool bMapNametables) {
 
 	if (bMapNametables && (Mapper68_NTM & 0x10)) {
 		// map a cached bank for nametable ROM into nametable memory
-		unsigned char* table0 = cacheSingleCHRBank(Mapper68_NT0 / 8) + 1024 * (Mapper68_NT0 & 7);
-		unsigned char* table1 = cacheSingleCHRBank(Mapper68_NT1 / 8) + 1024 * (Mapper68_NT1 & 7);
+		unsigned char* table0 = cacheCHRPage(Mapper68_NT0);
+		unsigned char* table1 = cacheCHRPage(Mapper68_NT1);
 		memcpy_fast32(nesPPU.nameTables, table0, 1024);
 		memcpy_fast32(nesPPU.nameTables+1, table1, 1024);
+#if BACKGROUND_LINE_CACHE
+		nesPPU.invalidateBackgroundLines();
+#endif
 	}
 }
 
@@ -33,7 +36,7 @@ void Mapper68_writeSpecial(unsigned int address, unsigned char value) {
 		if (address < 0x8000) {
 			if ((Mapper68_PRG & 0x10) && nesCart.numRAMBanks) {
 				// RAM
-				mainCPU.writeDirect(address, value);
+				mainCPU.writeWRAM(address, value);
 			}
 		} else {
 			address = address & 0xF000;
@@ -67,6 +70,9 @@ void Mapper68_writeSpecial(unsigned int address, unsigned char value) {
 					} else {
 						// returning nametables to RAM, uncache from our area
 						memcpy_fast32(nesPPU.nameTables, cacheArea, 2048);
+#if BACKGROUND_LINE_CACHE
+						nesPPU.invalidateBackgroundLines();
+#endif
 					}
 				}
 				switch (value & 3) {
@@ -72,7 +72,7 @@ void nes_cart::Mapper69_RunCommand(bool bIsForceUpdate) {
 			Mapper69_IRQ = 0;
 		}
 
-		unsigned int countClks = Mapper69_LASTCOUNTERCLK + Mapper69_LASTCOUNTER;
+		uint64 countClks = Mapper69_LASTCOUNTERCLK + Mapper69_LASTCOUNTER;
 		if (Mapper69_IRQCONTROL & 0x80) {
 			// keep the counter up to date
 			while (countClks < mainCPU.clocks) {
@@ -122,7 +122,7 @@ void Mapper69_writeSpecial(unsigned int address, unsigned char value) {
 			if ((Mapper69_PRG0 & 0xC0) == 0xC0) {
 				if (nesCart.numRAMBanks) {
 					// RAM
-					mainCPU.writeDirect(address, value);
+					mainCPU.writeWRAM(address, value);
 				}
 			}
 		} else if (address < 0xA000) {
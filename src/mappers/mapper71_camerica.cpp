@@ -9,7 +9,7 @@ void Mapper71_writeSpecial(unsigned int address, unsigned char value) {
 		if (address < 0x8000) {
 			if (nesCart.numRAMBanks) {
 				// RAM
-				mainCPU.writeDirect(address, value);
+				mainCPU.writeWRAM(address, value);
 			}
 		} else if (address >= 0xC000) {
 			// bank select
@@ -35,8 +35,7 @@ void nes_cart::setupMapper71_Camerica() {
 		DebugAssert(numCHRBanks == 0);
 		cachedBankCount--;
 		int chrBank = cachedBankCount;
-		nesPPU.chrPages[0] = cache[chrBank].ptr;
-		nesPPU.chrPages[1] = cache[chrBank].ptr + 0x1000;
+		nesPPU.setChrPages(0, 8, cache[chrBank].ptr);
 	}
 
 	// map first 16 KB of PRG mamory to 80-BF by default, and last 16 KB to C0-FF
@@ -65,7 +65,7 @@ void MMC2_writeSpecial(unsigned int address, unsigned char value) {
 	if (address >= 0x6000) {
 		if (address < 0x8000 && nesCart.numRAMBanks) {
 			// RAM
-			mainCPU.writeDirect(address, value);
+			mainCPU.writeWRAM(address, value);
 		} else if (address >= 0xA000) {
 			if (address < 0xB000) {
 				// PRG ROM select
@@ -33,6 +33,9 @@ enum NesKeys {
 	NES_P2_DOWN,
 	NES_P2_LEFT,
 	NES_P2_RIGHT,
+	NES_REWIND,
+	NES_MOVIE_RECORD,
+	NES_MOVIE_PLAY,
 	NES_MAX_KEYS
 };
 
@@ -44,26 +47,102 @@ bool keyDown_fast(unsigned char keyCode);
 #define MAX_CACHED_ROM_BANKS 32
 #define STATIC_CACHED_ROM_BANKS 24
 
+// memory maps the whole ROM file so PRG and CHR banks point straight into it instead of being copied into cache[]
+#ifndef DIRECT_ROM_MAPPING
+#define DIRECT_ROM_MAPPING TARGET_HOST
+#endif
+
+#if DIRECT_ROM_MAPPING && !TARGET_HOST
+#error DIRECT_ROM_MAPPING requires the host file layer
+#endif
+
+// slots in the cached bank lookup, a power of 2 well above the most PRG banks and CHR pages cache[] can hold
+#define BANK_HASH_SIZE 512
+
+// battery backed RAM is tracked in 32 pages of 256 bytes, so saving only has to look at what the game wrote
+#define WRAM_PAGE_COUNT 32
+
+// frames WRAM has to go unwritten before dirty pages are saved to the .sav file during play (0 only saves on pause)
+#ifndef WRAM_AUTOSAVE_FRAMES
+#define WRAM_AUTOSAVE_FRAMES 300
+#endif
+
+// compressed ROM container: "NZ7" $1A, the 16 byte iNES header, big endian ROM data size, then a big endian table of
+// chunk file offsets (one more than the number of chunks, so each chunk size is known)
+#define NZ7_HEADER_SIZE 24
+
+// slots in the bank successor history, direct mapped so a collision just forgets the older bank
+#define BANK_HISTORY_SIZE 256
+
+// bytes of ROM the vblank prefetch may copy into the bank cache per frame (0 disables it)
+#ifndef BANK_PREFETCH_BUDGET
+#define BANK_PREFETCH_BUDGET 16384
+#endif
+
 struct nes_cached_bank {
 	unsigned char* ptr;
-	int32 request;
+
+	// neighbours in the least recently used list (-1 at either end)
+	int8 lruNewer;
+	int8 lruOlder;
+
+	// predecoded instruction records for each byte of the bank when it holds PRG (see PREDECODE_INSTRUCTIONS)
+	uint32* predecode;
 
 	int32 prgIndex;
-	int16 chrIndex[8];
+	int16 chrIndex[8];				// 1 KB CHR bank held in each 1 KB of the bank when it holds CHR (-1 if empty)
+	uint8 patchedSlots;				// bit per PRG slot whose Game Genie codes were applied since the bank was filled
 
 	void clear() {
-		request = -1;
 		prgIndex = -2;
+		patchedSlots = 0;
+		invalidatePredecode();
+	}
+
+	// bank contents are changing, so all records need to be rebuilt
+	void invalidatePredecode() {
+		if (predecode) {
+			memset(predecode, 0, 8192 * sizeof(uint32));
+		}
 	}
 };
 
+// bank cache activity, accumulated since the ROM was loaded
+struct nes_bank_stats {
+	uint32 hits;
+	uint32 misses;
+	uint32 evictions;
+	uint32 bytesRead;				// bytes copied out of the ROM file by BlockRead
+	uint32 prefetches;				// banks and pages loaded ahead of time during vblank
+};
+
+// Game Genie code prepared for the cart
+struct nes_gg_patch {
+	uint16 addr;
+	uint8 set;
+	uint8 cmp;
+	bool bCompare;					// only patch when the byte there is cmp
+};
+
+// bank that last replaced the given one in the memory map
+struct nes_bank_history_entry {
+	int32 key;						// -1 if empty
+	int32 next;
+};
+
+// maps a PRG bank or CHR page key to its location in cache[] (bank * 8 + 1 KB page)
+struct nes_bank_hash_entry {
+	int32 key;						// -1 if empty
+	int32 location;
+};
+
 // specifications about the cart, rom file, mapper, etc
 struct nes_cart {
-	nes_cart();
-
 	int handle;						// current file handle
 
-	uint32 savHash;					// hash of battery backed RAM contents
+	uint32 savPageHash[WRAM_PAGE_COUNT];	// hash of each page of battery backed RAM as last saved
+	uint32 wramDirtyPages;			// bit per page written since the last save
+	int wramQuietFrames;			// frames since the last write to WRAM
 	char romFile[128];				// file name, if this is set, then the cart is setup to run 
 	char savFile[128];				// cached .sav file name for writing to .SAV on exit
 
@@ -80,6 +159,9 @@ struct nes_cart {
 	// up to 32 internal registers
 	unsigned int registers[32];
 
+	// up to 4 internal mapper timestamps in master cpu clocks
+	uint64 clockRegisters[4];
+
 	// bank index storage for program memory (which 8 KB from cart at 0x8000, 0xA000, 0xC000, amd 0xE000). Index 5 is for mappers that map to 0x6000 (only used if isLowPRGROM is true)
 	int32 programBanks[5];
 
@@ -107,13 +189,47 @@ struct nes_cart {
 	nes_cached_bank cache[MAX_CACHED_ROM_BANKS];
 
 	// common bank caching set up. Caching is used for PRG and CHR. RAM is stored permanently in memory
-	int requestIndex;
+	nes_bank_hash_entry bankHash[BANK_HASH_SIZE];
+	int lruNewest;					// most recently requested bank, -1 until the list is built on first use
+	int lruOldest;
+	int chrFillBank;				// bank currently taking new CHR pages (-1 if none)
+	int chrFillPage;
+
+	nes_bank_stats bankStats;
+
+	// bank that last replaced each PRG bank / CHR page in the memory map, used to prefetch during vblank
+	nes_bank_history_entry bankHistory[BANK_HISTORY_SIZE];
+	void recordNextBank(int32 key, int32 nextKey);
+	int32 predictNextBank(int32 key);
+
+	// copies the banks most likely to be mapped next into the cache, called while the PPU idles in vblank
+	void PrefetchBanks();
+
+	// Game Genie codes patch the bank mapped into their 8 KB slot when the slot is remapped, a cached bank only once
+	// per slot until it is filled again
+	nes_gg_patch slotPatches[10];
+	int numSlotPatches;
+	uint8 slotPatchMask;			// bit per programBanks slot that has a slot patch
+	void BuildGameGeniePatches();
+	void applySlotPatches(uint8 remappedSlots);
 
 	// number of 8 KB banks to use for PRG & CHR (some cached banks are used for permanently mapped RAM, etc)
 	int cachedBankCount;
 
-	// returns hash of RAM contents
-	uint32 GetRAMHash();
+	// returns hash of a 256 byte page of RAM
+	uint32 GetRAMPageHash(int page);
+
+	// called for CPU writes that store into RAM at 0x6000 - 0x7FFF (see nes_cpu::writeWRAM)
+	FORCE_INLINE void markWRAMDirty(unsigned int address) {
+		wramDirtyPages |= 1u << ((address >> 8) & (WRAM_PAGE_COUNT - 1));
+		wramQuietFrames = 0;
+	}
+
+	// writes the .sav file if any page written since the last save changed, returns true if the file was written
+	bool WriteSaveFile();
+
+	// called once per frame, saves dirty battery backed RAM once the game stops writing it
+	void AutoSaveWRAM();
 
 	// called when pausing emulator back to frontend
 	void OnPause();
@@ -134,6 +250,31 @@ struct nes_cart {
 	unsigned char* blocks[1024];	
 	bool BuildFileBlocks();
 	void BlockRead(unsigned char* intoMem, int size, int offset);
+	void BlockCopy(unsigned char* intoMem, int size, int offset);
+
+	// compressed ROM container (.nz7), ROM data after the iNES header is ZX7 compressed in 8 KB chunks
+	uint32* chunkOffsets;			// file offset of each chunk and the end of the last, NULL for plain iNES files
+	int numChunks;
+	int romDataSize;				// uncompressed size of the ROM data
+	int decodedChunk;				// chunk held in chunkBuffer, or -1
+	unsigned char* chunkBuffer;		// decompressed chunk that partial reads (1 KB CHR pages) are copied from
+	unsigned char* packedBuffer;	// compressed chunk copied out of the file blocks
+	bool loadChunkTable(int file, int fileSize);
+	void freeChunks();
+	void decompressChunk(int chunk, unsigned char* intoMem);
+	void ChunkRead(unsigned char* intoMem, int size, int offset);
+
+#if DIRECT_ROM_MAPPING
+	// whole ROM file mapped for the lifetime of the cart, NULL when banks go through the cache instead
+	unsigned char* romData;
+	int romSize;
+
+	// predecode records per 8 KB PRG bank of the mapped file (allocated on first use)
+	uint32** romPredecode;
+
+	void mapROM(const char* withFile, int expectedSize);
+	void unmapROM();
+#endif
 
 	// called on all writes over 0x4020
 	void(*writeSpecial)(unsigned int address, unsigned char value);
@@ -148,18 +289,41 @@ struct nes_cart {
 
 	// returns whether the bank given is in use by the memory map
 	bool isBankUsed(int index);
+	int countUnusedBanks();
 
-	// finds least recently requested bank that is currently unused
+	// finds least recently requested bank that is currently unused, and drops what it held from the lookup
 	int findOldestUnusedBank();
 
+	// cached bank lookup by PRG bank index or CHR page key, returns location (bank * 8 + page) or -1
+	int findCachedBank(int32 key);
+	void addCachedBank(int32 key, int32 location);
+	void removeCachedBank(int32 key);
+
+	// moves the bank to the front of the least recently used list
+	void touchBank(int index);
+
+	// empties the lookup and least recently used list (rebuilt from cachedBankCount on next use)
+	void resetBankLookup();
+
 	// caches an 8 KB PRG bank (so index up to 2 * numPRGBanks), returns result bank memory pointer
 	unsigned char* cachePRGBank(int index);
 
-	// caches a 8 KB CHR bank based on the given 1 KB indices, returns result bank memory pointer
-	unsigned char* cacheCHRBank(int16* indices);
+	// caches a 1 KB CHR bank (so index up to 8 * numCHRBanks), returns result page memory pointer
+	unsigned char* cacheCHRPage(int index);
+
+	// cache miss paths of the above, load into the least recently requested unused bank
+	unsigned char* loadPRGBank(int index);
+	unsigned char* loadCHRPage(int index);
+
+	// returns the predecode records for the cached bank at the given pointer (allocated on first use), NULL if unavailable
+	uint32* getPredecodeRecords(unsigned char* bankPtr);
+
+	// whether cache[index] holds the same bank as when the given copy of it was made
+	bool holdsSameBank(int index, const nes_cached_bank& copy);
 
-	// caches a single 8 KB CHR bank based on the 8 KB index, returns result bank memory pointer
-	unsigned char* cacheSingleCHRBank(int16 index);
+	// returns where the data ptr pointed to now, given copies of cache[] from when it was valid (loads the bank again
+	// if it has since been replaced)
+	unsigned char* relocateBankPointer(unsigned char* ptr, const nes_cached_bank* copies);
 
 	// sets up bank pointers with the given allocated data
 	void allocateBanks(unsigned char* staticAlloced);
@@ -176,9 +340,6 @@ struct nes_cart {
 	// Sets up loaded ROM File with the selected mapper (returns false if unsupported)
 	bool setupMapper();
 
-	// rollback the clock counts in any mapper used registers by the given amt
-	void rollbackClocks(unsigned int clockCount);
-
 	// various mapper setups and functions
 	void setupMapper0_NROM();
 
@@ -243,11 +404,27 @@ struct nes_nametable {
 	unsigned char attr[64];
 };
 
-extern nes_cart nesCart;
+extern MACHINE_STATE nes_cart nesCart;
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // PPU
 
+// caches decoded tile rows for the 16 most recently used 1 KB character pages (about 4 KB per page, 65 KB in all,
+// so off where memory is tight)
+#ifndef DECODED_TILE_CACHE
+#define DECODED_TILE_CACHE (TARGET_WINSIM || TARGET_HOST)
+#endif
+
+// keeps each scanline's background and reuses it while its inputs are unchanged (costs 70 KB, relies on the
+// decoded tile cache invalidation to see CHR changes)
+#ifndef BACKGROUND_LINE_CACHE
+#define BACKGROUND_LINE_CACHE DECODED_TILE_CACHE
+#endif
+
+#if BACKGROUND_LINE_CACHE && !DECODED_TILE_CACHE
+#error BACKGROUND_LINE_CACHE requires DECODED_TILE_CACHE
+#endif
+
 #define PPUCTRL_FLIPXTBL    (1 << 0)		// flip the x axis nametable lookup? (doesn't matter for horizontal lookup)
 #define PPUCTRL_FLIPYTBL    (1 << 1)		// flip the y axis nametable lookup? (doesn't matter for vertical lookup)
 #define PPUCTRL_VRAMINC		(1 << 2)		// 0 = +1, 1 = +32
@@ -285,6 +462,22 @@ namespace nes_mirror_type {
 	};
 }
 
+// sprites touching each visible scanline as OAM byte offsets in OAM order, rebuilt when OAM is dirty
+struct nes_sprite_lines {
+	uint8 count[241];
+	uint16 start[242];
+	bool overflow[241];			// more than 8 sprites on the line
+	uint8 list[64 * 16];
+
+	// settings the lists were built with
+	int spriteSize;
+	bool bLimited;
+
+	const uint8* getSprites(unsigned int scanline) const {
+		return &list[start[scanline]];
+	}
+};
+
 struct nes_ppu {
 	// registers (some of them map to $2000-$2007, but this is handled case by case)
 	unsigned char PPUCTRL;			// $2000
@@ -316,8 +509,34 @@ struct nes_ppu {
 	// up to four name tables potentially (most games use 2)
 	nes_nametable* nameTables;
 
-	// character memory split into 4 kb pages (0x0000 and 0x1000)
-	unsigned char* chrPages[2];
+	// character memory split into 1 kb pages (0x0000 - 0x1FFF)
+	unsigned char* chrPages[8];
+
+	// returns the 16 byte pattern for the given tile (0 - 511, tiles from 256 are in the 0x1000 table)
+	FORCE_INLINE unsigned char* getTile(unsigned int tile) {
+		return chrPages[tile >> 6] + ((tile & 63) << 4);
+	}
+
+	// points numKB pages starting at firstKB to consecutive 1 kb of the given memory
+	void setChrPages(int firstKB, int numKB, unsigned char* ptr) {
+		for (int i = 0; i < numKB; i++) {
+			chrPages[firstKB + i] = ptr + 1024 * i;
+		}
+	}
+
+#if DECODED_TILE_CACHE
+	// drops decoded tiles for all pattern tables, or for any that overlap the given character memory
+	void invalidateDecodedTiles();
+	void invalidateDecodedTiles(const unsigned char* ptr, unsigned int size);
+#endif
+
+#if BACKGROUND_LINE_CACHE
+	// marks cached background lines that read the given name table byte, the given character memory, or all lines,
+	// as stale
+	void nameTableWritten(const unsigned char* ptr);
+	void chrWritten(const unsigned char* ptr, unsigned int size);
+	void invalidateBackgroundLines();
+#endif
 
 	// current scanline (0 = prerender line, 1 = first real scanline)
 	unsigned int scanline;
@@ -340,6 +559,7 @@ struct nes_ppu {
 	// oam data
 	unsigned char oam[0x100];
 	bool dirtyOAM;
+	nes_sprite_lines spriteLines;
 	
 	// working palette (actual LCD colors of each palette entry from palette[], accounts for background color mirroring)
 	uint16 workingPalette[0x20];
@@ -356,8 +576,10 @@ struct nes_ppu {
 
 	// perform an OAM dma from the given CPU memory address
 	void oamDMA(unsigned int addr);
-	template<int spriteSize> void resolveOAM();
-	void resolveOAMExternal();
+	template<int spriteSize> void resolveOAM(bool bLimited);
+
+	// rebuilds spriteLines if OAM, the sprite size or the sprite limit setting changed
+	void updateSpriteLines();
 	void fastOAMLatchCheck();
 
 	// reading / writing
@@ -369,7 +591,7 @@ struct nes_ppu {
 			}
 
 			// pattern table memory
-			return &chrPages[address >> 12][address & 0x0FFF];
+			return &chrPages[address >> 10][address & 0x03FF];
 		} else if (address < 0x3F00 || mirrorBehindPalette) {
 			// name table memory
 			switch (mirror) {
@@ -433,6 +655,7 @@ struct nes_ppu {
 	void initScanlineBuffer();
 	void fastSprite0(bool bValidBackground);
 	void doOAMRender();
+	void renderCurrentScanline();
 	void resolveScanline(int scrollOffset);
 	void finishFrame(bool bSkippedFrame);
 
@@ -459,7 +682,7 @@ struct nes_ppu {
 #define USE_DMA TARGET_PRIZM
 
 // main ppu registers (2000-2007 and emulated latch)
-extern nes_ppu nesPPU;
+extern MACHINE_STATE nes_ppu nesPPU;
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // APU
@@ -564,10 +787,6 @@ struct nes_apu_dmc {
 
 // audio processing unit main struct
 struct nes_apu {
-	nes_apu() {
-		init();
-	}
-
 	nes_apu_pulse pulse1;
 	nes_apu_pulse pulse2;
 	nes_apu_triangle triangle;
@@ -609,7 +828,7 @@ struct nes_apu {
 
 };
 
-extern nes_apu nesAPU;
+extern MACHINE_STATE nes_apu nesAPU;
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // INPUT
@@ -623,4 +842,174 @@ void input_writeStrobe(unsigned char value);
 void input_readController1();
 void input_readController2();
 
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// SNAPSHOT
+
+// layout version of in-memory snapshots, bump when any struct they copy changes
+#define SNAPSHOT_VERSION 1
+
+// the whole machine state copied flat into memory for rewind and run-ahead. Unlike save states there is no file
+// format, so a snapshot is only valid for the cart that was loaded in the same build it was captured with
+struct Snapshot {
+	// bytes needed for a snapshot of the loaded cart
+	static uint32 GetSize();
+
+	// copies the machine state to buffer (GetSize() bytes, 4 byte aligned), returns bytes written
+	static uint32 Capture(uint8* buffer);
+
+	// returns false if the buffer is not a snapshot of the loaded cart
+	static bool Restore(const uint8* buffer);
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// REWIND
+
+// bytes of memory for rewind history and the three snapshots it works with (0 disables rewind, as on the calculator
+// where the heap is left to cache[])
+#ifndef REWIND_BUFFER_SIZE
+#if TARGET_WINSIM || TARGET_HOST
+#define REWIND_BUFFER_SIZE (1024 * 1024)
+#else
+#define REWIND_BUFFER_SIZE 0
+#endif
+#endif
+
+// frames between rewind points
+#ifndef REWIND_INTERVAL
+#define REWIND_INTERVAL 8
+#endif
+
+// bytes of a new rewind point compared with the previous one per frame, so the cost is spread over the interval
+#ifndef REWIND_ENCODE_BUDGET
+#define REWIND_ENCODE_BUDGET 4096
+#endif
+
+// Snapshots taken every REWIND_INTERVAL frames. Only the newest is kept whole, every older one is stored as the XOR
+// against the one after it with runs of zero words removed, in a ring buffer that drops the oldest when full
+struct nes_rewind {
+	uint8* memory;					// REWIND_BUFFER_SIZE bytes, allocated on first use
+	uint32 snapshotSize;
+
+	uint8* latest;					// newest rewind point
+	uint8* pending;					// next rewind point while it is being encoded
+	uint32* encoded;				// delta between pending and latest
+	bool bHasLatest;
+	bool bAtLatest;					// emulation was put back to latest and has not run since
+	bool bEncoding;
+	int framesUntilCapture;
+
+	// encoder state, in words of the snapshots
+	uint32 encodePos;
+	uint32 encodedWords;
+	uint32 runHeader;				// word of encoded holding the zero and literal counts of the current run
+	uint32 zeroWords;
+	uint32 literalWords;
+
+	// deltas, each stored as its size in words, the words, then the size again so the newest can be found from head
+	uint32* ring;
+	uint32 ringWords;
+	uint32 head;
+	uint32 tail;
+	uint32 wrapEnd;					// end of the entries before head wrapped back to the start
+	int numEntries;
+
+	// drops all history and sets up the buffers for the loaded cart
+	void reset();
+
+	// called once per frame, captures and encodes rewind points or steps back while the rewind key is held
+	void step();
+
+	// puts emulation back to the previous rewind point, returns false if there is no history
+	bool stepBack();
+
+	void encode(uint32 endPos);
+	void pushEntry();
+	void popEntry();
+	void dropOldest();
+};
+
+extern MACHINE_STATE nes_rewind nesRewind;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// RUN AHEAD
+
+// Hides the input lag games add themselves. When a frame ends the machine is captured, the next few frames are run
+// with the input just read and only the last of them is drawn, then the machine is put back. The real frames are
+// never drawn and the frames run ahead are never heard
+struct nes_runahead {
+	uint8* state;					// snapshot of the real frame, allocated when first needed
+	int frames;						// frames to run ahead this frame (ST_RunAhead), 0 when off
+	int framesLeft;					// frames still to run ahead, the one shown is the last
+	bool bRunning;
+	bool bShownSkipped;				// frame skip decided for the real frame, which the frame shown uses instead
+
+	// time spent running ahead in GetCycles() units, for deciding whether a device can afford it
+	uint32 cycles;
+	uint32 numRuns;
+
+	// drops the snapshot of the previous cart
+	void reset();
+
+	// called at the start of each frame with the frame skip decision, returns whether to skip rendering this frame
+	bool filterSkipFrame(bool bSkipFrame);
+
+	// called once the real frame is over, runs ahead, shows the last frame and puts the machine back
+	void run();
+};
+
+extern MACHINE_STATE nes_runahead nesRunAhead;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// MOVIE
+
+// longest movie that can be recorded, in frames
+#ifndef MOVIE_MAX_FRAMES
+#define MOVIE_MAX_FRAMES (60 * 60 * 5)
+#endif
+
+// layout version of movie files, bump when the header or frame format changes
+#define MOVIE_VERSION 1
+
+// where the machine is when a movie starts
+enum MovieAnchor {
+	MA_PowerOn,					// just loaded, before the first frame
+	MA_SaveState,				// the cart's save state (.fcs), written when recording starts
+};
+
+// Controller input recorded once per frame (as input_cacheKeys leaves it) and played back in place of the keys, so
+// the same run can be replayed after every change. The file sits beside the ROM (.nzm) and holds a hash of the ROM
+// and of RAM at the anchor, so a movie is never played against a different game or starting point
+struct nes_movie {
+	uint8* frames;					// two bytes per frame, player 1 then player 2 buttons in NES_P1_A order
+	int numFrames;
+	int curFrame;					// next frame to play
+	bool bRecording;
+	bool bPlaying;
+	MovieAnchor anchor;
+	uint32 romHash;
+	uint32 anchorHash;
+
+	// puts the machine at the anchor and starts recording from the input already read this frame
+	bool StartRecording(MovieAnchor withAnchor);
+
+	// loads the cart's movie, puts the machine at its anchor and starts playing
+	bool StartPlayback();
+
+	// stops recording (writing the file) or playback
+	void Stop();
+
+	// called from input_cacheKeys, records or replaces the controller input just read
+	void cacheKeys();
+
+	// called once per frame, starts and stops movies from the movie keys
+	void step();
+
+	void recordFrame();
+	void playFrame();
+	bool writeFile();
+	bool readFile();
+};
+
+extern MACHINE_STATE nes_movie nesMovie;
+
 #include "6502.h"
\ No newline at end of file
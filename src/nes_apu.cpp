@@ -9,8 +9,8 @@
 #include "scope_timer/scope_timer.h"
 #include "snd/snd.h"
 
-nes_apu nesAPU;
-bool bSoundEnabled = false;
+MACHINE_STATE nes_apu nesAPU;
+MACHINE_STATE bool bSoundEnabled = false;
 
 #if DEBUG
 // debug muting of various mixers
@@ -604,6 +604,7 @@ void nes_apu::writeReg(unsigned int address, uint8 value) {
 
 		// reset step counter
 		mainCPU.apuClocks = mainCPU.clocks + (nesCart.isPAL ? palFrame : ntscFrame);
+		mainCPU.events.schedule(CPU_EVENT_APU, mainCPU.apuClocks);
 		cycle = 0;
 	}
 }
@@ -8,12 +8,19 @@
 #include "scope_timer/scope_timer.h"
 #include "snd/snd.h"
 #include "settings.h"
+#include "zx7_checked.h"
 
-nes_cart nesCart;
+MACHINE_STATE nes_cart nesCart;
 
-nes_nametable nes_onboardPPUTables[4];
+// prgIndex of cached banks that hold 1 KB CHR pages
+#define CHR_CACHE_INDEX 4096
 
-unsigned char openBus[256] = {
+// bank lookup key of a 1 KB CHR page (PRG banks use their index, which is always below this)
+#define CHR_PAGE_KEY(index) (0x10000 | (index))
+
+MACHINE_STATE nes_nametable nes_onboardPPUTables[4];
+
+MACHINE_STATE unsigned char openBus[256] = {
 	0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xAA, 0xBB, 0xCC, 0xDD, 0xEE, 0xFF,
 	0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xAA, 0xBB, 0xCC, 0xDD, 0xEE, 0xFF,
 	0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xAA, 0xBB, 0xCC, 0xDD, 0xEE, 0xFF,
@@ -32,11 +39,6 @@ unsigned char openBus[256] = {
 	0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xAA, 0xBB, 0xCC, 0xDD, 0xEE, 0xFF,
 };
 
-nes_cart::nes_cart() : writeSpecial(NULL) {
-	handle = 0;
-	romFile[0] = 0;
-}
-
 void nes_cart::allocateBanks(unsigned char* staticAlloced) {
 	allocatedROMBanks = STATIC_CACHED_ROM_BANKS;
 	for (int i = 0; i < STATIC_CACHED_ROM_BANKS; i++) {
@@ -57,6 +59,8 @@ void nes_cart::allocateBanks(unsigned char* staticAlloced) {
 bool nes_cart::loadROM(const char* withFile) {
 	DebugAssert(handle <= 0);
 
+	freeChunks();
+
 	printf("Loading %s...", withFile);
 
 	unsigned short romName[256];
@@ -80,6 +84,20 @@ bool nes_cart::loadROM(const char* withFile) {
 	
 	int expectedSize = 16;	// starting with header size
 
+	// compressed container starts with 'N' 'Z' '7' $1A followed by the iNES header
+	const unsigned char packedType[4] = { 0x4E, 0x5A, 0x37, 0x1A };
+	if (!memcmp(header, packedType, 4)) {
+		if (fileSize < NZ7_HEADER_SIZE || Bfile_ReadFile_OS(file, header, 16, 4) != 16 || !loadChunkTable(file, fileSize)) {
+			printf("Could not read compressed ROM");
+			Bfile_CloseFile_OS(file);
+			freeChunks();
+			return false;
+		}
+
+		// sizes below are for the uncompressed file
+		fileSize = 16 + romDataSize;
+	}
+
 	// check 4 bytes for 'N' 'E' 'S' $1A
 	const unsigned char type[4] = { 0x4E, 0x45, 0x53, 0x1A };
 	if (memcmp(header, type, 4)) {
@@ -195,13 +213,15 @@ bool nes_cart::loadROM(const char* withFile) {
 	printf("%s, %d RAM banks", isPAL ? "PAL" : "NTSC", numRAMBanks);
 
 	// expected size?
-	if (Bfile_GetFileSize_OS(file) != expectedSize) {
+	if (fileSize != expectedSize) {
 		printf("Not expected file size based on format, will attempt to pad!");
 	}
 
 	// load 8 kb .SAV file if available
 	availableROMBanks = allocatedROMBanks - numRAMBanks;
 	savFile[0] = 0;
+	wramDirtyPages = 0;
+	wramQuietFrames = 0;
 	if (numRAMBanks) {
 		for (int i = 0; i < numRAMBanks; i++) {
 			memset(cache[availableROMBanks + i].ptr, 0, 8192);
@@ -220,10 +240,19 @@ bool nes_cart::loadROM(const char* withFile) {
 				Bfile_CloseFile_OS(saveFileHandle);
 			}
 
-			savHash = GetRAMHash();
+			for (int i = 0; i < WRAM_PAGE_COUNT; i++) {
+				savPageHash[i] = GetRAMPageHash(i);
+			}
 		}
 	}
 
+	// CHR RAM takes the last ROM bank (see the mapper setups), which still holds whatever the last ROM left there
+	if (numCHRBanks == 0) {
+		memset(cache[availableROMBanks - 1].ptr, 0, 8192);
+	}
+
+	memset(&bankStats, 0, sizeof(bankStats));
+
 	// default memory mapping first
 	mainCPU.mapDefaults();
 
@@ -235,17 +264,32 @@ bool nes_cart::loadROM(const char* withFile) {
 
 	// load game genie codes file if user supplied one
 	GameGenieCode::load(withFile);
+	BuildGameGeniePatches();
+
+#if DIRECT_ROM_MAPPING
+	// compressed banks have to be decompressed into the cache, and must not be read from a ROM mapped before this one
+	if (chunkOffsets) {
+		unmapROM();
+	} else {
+		mapROM(withFile, expectedSize);
+	}
+#endif
 
 	// mapper logic
 	handle = file;
 	if (setupMapper()) {
 		strcpy(romFile, withFile);
 		printf("Mapper %d : supported", mapper);
+		nesRewind.reset();
+		nesRunAhead.reset();
 		return true;
 	} else {
 		handle = 0;
 		printf("Mapper %d : unsupported", mapper);
 		Bfile_CloseFile_OS(file);
+#if DIRECT_ROM_MAPPING
+		unmapROM();
+#endif
 		return false;
 	}
 }
@@ -253,6 +297,7 @@ bool nes_cart::loadROM(const char* withFile) {
 void nes_cart::readState_WRAM(uint8* data) {
 	if (numRAMBanks >= 1) {
 		memcpy_fast32(cache[availableROMBanks].ptr, data, 0x2000);
+		wramDirtyPages = 0xFFFFFFFF;
 	}
 }
 
@@ -269,39 +314,90 @@ void nes_cart::unload() {
 		Bfile_CloseFile_OS(handle);
 		handle = 0;
 	}
+
+#if DIRECT_ROM_MAPPING
+	unmapROM();
+#endif
+
+	freeChunks();
 }
 
-uint32 nes_cart::GetRAMHash() {
+uint32 nes_cart::GetRAMPageHash(int page) {
 	uint32 hash = 0x13371337;
 	if (numRAMBanks) {
-		for (int i = 0; i < 8192; i++) {
-			hash = hash * 31 + cache[availableROMBanks].ptr[i];
+		const unsigned char* data = cache[availableROMBanks].ptr + page * 256;
+		for (int i = 0; i < 256; i++) {
+			hash = hash * 31 + data[i];
 		}
 	}
 	return hash;
 }
 
-void nes_cart::OnPause() {
-	if (savFile[0]) {
-		uint32 curRAMHash = GetRAMHash();
+bool nes_cart::WriteSaveFile() {
+	if (!savFile[0] || !wramDirtyPages) {
+		return false;
+	}
 
-		if (curRAMHash != savHash) {
-			savHash = curRAMHash;
+	// written pages often end up the same (checksums, counters that wrap back), so compare before touching flash
+	uint32 pageHash[WRAM_PAGE_COUNT];
+	bool bChanged = false;
+	for (int i = 0; i < WRAM_PAGE_COUNT; i++) {
+		pageHash[i] = (wramDirtyPages & (1u << i)) ? GetRAMPageHash(i) : savPageHash[i];
+		bChanged |= pageHash[i] != savPageHash[i];
+	}
 
-			unsigned short fileName[256];
-			Bfile_StrToName_ncpy(fileName, savFile, 255);
+	if (!bChanged) {
+		wramDirtyPages = 0;
+		return false;
+	}
 
-			size_t size = 8192;
-			Bfile_CreateEntry_OS(fileName, CREATEMODE_FILE, &size);
+	unsigned short fileName[256];
+	Bfile_StrToName_ncpy(fileName, savFile, 255);
 
-			int savHandle = Bfile_OpenFile_OS(fileName, WRITE, 0);
-			if (savHandle >= 0) {
-				Bfile_WriteFile_OS(savHandle, cache[availableROMBanks].ptr, 8192);
-				Bfile_CloseFile_OS(savHandle);
-			}
+	// the OS will not create over an existing file, so only create one when there is nothing to open
+	int savHandle = Bfile_OpenFile_OS(fileName, WRITE, 0);
+	if (savHandle < 0) {
+		size_t size = 8192;
+		if (Bfile_CreateEntry_OS(fileName, CREATEMODE_FILE, &size) != 0) {
+			return false;
 		}
+
+		savHandle = Bfile_OpenFile_OS(fileName, WRITE, 0);
+		if (savHandle < 0) {
+			return false;
+		}
+	}
+
+	const int written = Bfile_WriteFile_OS(savHandle, cache[availableROMBanks].ptr, 8192);
+	Bfile_CloseFile_OS(savHandle);
+
+	// the pages stay dirty until they are on flash, so a failed save is tried again
+	if (written < 0) {
+		return false;
 	}
 
+	memcpy(savPageHash, pageHash, sizeof(savPageHash));
+	wramDirtyPages = 0;
+	return true;
+}
+
+void nes_cart::AutoSaveWRAM() {
+#if WRAM_AUTOSAVE_FRAMES
+	if (savFile[0] && wramDirtyPages && ++wramQuietFrames == WRAM_AUTOSAVE_FRAMES) {
+		// writing a file moves flash around, so block addresses need to be rebuilt like after a save state
+		if (WriteSaveFile()) {
+			BuildFileBlocks();
+		}
+	}
+#endif
+}
+
+void nes_cart::OnPause() {
+	// leaving the game ends a movie, and a recording is written before the ROM is closed
+	nesMovie.Stop();
+
+	WriteSaveFile();
+
 	// close rom handle for now (will re open on continue)
 	Bfile_CloseFile_OS(handle);
 	handle = 0;
@@ -329,6 +425,7 @@ bool nes_cart::setupMapper() {
 	clearCacheData();
 
 	memset(registers, 0, sizeof(registers));
+	memset(clockRegisters, 0, sizeof(clockRegisters));
 	memset(programBanks, 0xFF, sizeof(programBanks));
 	memset(chrBanks, 0xFF, sizeof(chrBanks));
 
@@ -416,6 +513,16 @@ bool nes_cart::BuildFileBlocks() {
 void nes_cart::BlockRead(unsigned char* intoMem, int size, int offset) {
 	TIME_SCOPE()
 
+	if (chunkOffsets) {
+		ChunkRead(intoMem, size, offset);
+	} else {
+		BlockCopy(intoMem, size, offset);
+	}
+}
+
+void nes_cart::BlockCopy(unsigned char* intoMem, int size, int offset) {
+	bankStats.bytesRead += size;
+
 	while (size) {
 		const int blockNum = offset >> 12;
 		const int offsetInBlock = offset & 0xFFF;
@@ -429,26 +536,203 @@ void nes_cart::BlockRead(unsigned char* intoMem, int size, int offset) {
 		size -= toRead;
 		offset += toRead;
 
-		condSoundUpdate();
+		if (!nesRunAhead.bRunning) {
+			condSoundUpdate();
+		}
 	}
 }
 
+static uint32 ReadBigEndian32(const unsigned char* data) {
+	return (data[0] << 24) | (data[1] << 16) | (data[2] << 8) | data[3];
+}
+
+bool nes_cart::loadChunkTable(int file, int fileSize) {
+	unsigned char sizeData[4];
+	if (Bfile_ReadFile_OS(file, sizeData, 4, 20) != 4) {
+		return false;
+	}
+
+	romDataSize = ReadBigEndian32(sizeData);
+	numChunks = (romDataSize + 8191) / 8192;
+	if (romDataSize <= 0 || NZ7_HEADER_SIZE + 4 * (numChunks + 1) > fileSize) {
+		return false;
+	}
+
+	int tableSize = 4 * (numChunks + 1);
+	unsigned char* table = (unsigned char*) malloc(tableSize);
+	chunkOffsets = (uint32*) malloc(tableSize);
+	chunkBuffer = (unsigned char*) malloc(8192);
+	packedBuffer = (unsigned char*) malloc(8192 + 2);
+	if (!table || !chunkOffsets || !chunkBuffer || !packedBuffer || Bfile_ReadFile_OS(file, table, tableSize, NZ7_HEADER_SIZE) != tableSize) {
+		free(table);
+		return false;
+	}
+
+	// chunks must be in order, within the file, and no bigger than a stored 8 KB chunk
+	bool bValid = true;
+	for (int i = 0; i <= numChunks; i++) {
+		chunkOffsets[i] = ReadBigEndian32(table + 4 * i);
+		if (i && (chunkOffsets[i] <= chunkOffsets[i - 1] || chunkOffsets[i] - chunkOffsets[i - 1] > 8192 + 2)) {
+			bValid = false;
+		}
+	}
+	free(table);
+
+	decodedChunk = -1;
+	return bValid && chunkOffsets[numChunks] <= uint32(fileSize);
+}
+
+void nes_cart::freeChunks() {
+	free(chunkOffsets);
+	free(chunkBuffer);
+	free(packedBuffer);
+	chunkOffsets = NULL;
+	chunkBuffer = NULL;
+	packedBuffer = NULL;
+}
+
+void nes_cart::decompressChunk(int chunk, unsigned char* intoMem) {
+	// chunks past the end of the file read as 0 like a padded ROM
+	if (chunk >= numChunks) {
+		memset(intoMem, 0, 8192);
+		return;
+	}
+
+	// the file blocks are not contiguous, so the packed chunk is copied out first
+	int packedSize = chunkOffsets[chunk + 1] - chunkOffsets[chunk];
+	BlockCopy(packedBuffer, packedSize, chunkOffsets[chunk]);
+
+	int chunkSize = romDataSize - chunk * 8192;
+	if (chunkSize > 8192) chunkSize = 8192;
+
+	// same block format as compressed images, 2 byte size (including itself) or 0 if stored uncompressed. A stored
+	// chunk has to hold all of its bytes
+	bool bValid = true;
+	if (packedSize < 2) {
+		bValid = false;
+	} else if (packedBuffer[0] | packedBuffer[1]) {
+		bValid = ZX7DecompressChecked(packedBuffer + 2, packedSize - 2, intoMem, chunkSize);
+	} else {
+		bValid = packedSize == chunkSize + 2;
+		if (bValid) {
+			memcpy(intoMem, packedBuffer + 2, chunkSize);
+		}
+	}
+
+	// a corrupt chunk reads as 0 rather than spilling into whatever follows it
+	if (!bValid) {
+		printf("Chunk %d of the ROM is corrupt", chunk);
+		memset(intoMem, 0, chunkSize);
+	}
+
+	if (chunkSize < 8192) {
+		memset(intoMem + chunkSize, 0, 8192 - chunkSize);
+	}
+}
+
+void nes_cart::ChunkRead(unsigned char* intoMem, int size, int offset) {
+	// offsets are into the uncompressed iNES file
+	offset -= 16;
+
+	while (size) {
+		const int chunk = offset >> 13;
+		const int offsetInChunk = offset & 0x1FFF;
+
+		int toRead = 0x2000 - offsetInChunk;
+		if (toRead > size) toRead = size;
+
+		// whole PRG banks decompress straight into the cache, CHR pages come from the last decompressed chunk
+		if (toRead == 0x2000) {
+			decompressChunk(chunk, intoMem);
+		} else {
+			if (decodedChunk != chunk) {
+				decompressChunk(chunk, chunkBuffer);
+				decodedChunk = chunk;
+			}
+			memcpy(intoMem, chunkBuffer + offsetInChunk, toRead);
+		}
+
+		intoMem += toRead;
+		size -= toRead;
+		offset += toRead;
+
+		if (!nesRunAhead.bRunning) {
+			condSoundUpdate();
+		}
+	}
+}
+
+#if DIRECT_ROM_MAPPING
+void nes_cart::mapROM(const char* withFile, int expectedSize) {
+	unmapROM();
+
+	unsigned short romName[256];
+	Bfile_StrToName_ncpy(romName, withFile, 255);
+	romData = Host_MapFile(romName, &romSize);
+
+	// files shorter than the header claims keep using the cache
+	if (romData && romSize < expectedSize) {
+		unmapROM();
+	}
+
+	if (romData) {
+		romPredecode = (uint32**) calloc(romSize / 8192 + 1, sizeof(uint32*));
+	} else {
+		printf("Could not map ROM, using bank cache");
+	}
+}
+
+void nes_cart::unmapROM() {
+	if (romPredecode) {
+		for (int i = 0; i < romSize / 8192 + 1; i++) {
+			free(romPredecode[i]);
+		}
+		free(romPredecode);
+		romPredecode = NULL;
+	}
+
+	Host_UnmapFile(romData, romSize);
+	romData = NULL;
+	romSize = 0;
+}
+#endif
+
 void nes_cart::clearCacheData() {
-	requestIndex = 0;
-	
 	for (int i = 0; i < availableROMBanks; i++) {
 		cache[i].clear();
 	}
 
+	resetBankLookup();
+
+	for (int i = 0; i < BANK_HISTORY_SIZE; i++) {
+		bankHistory[i].key = -1;
+	}
+
+#if DECODED_TILE_CACHE
+	nesPPU.invalidateDecodedTiles();
+#endif
+
 	cachedBankCount = 0;
 }
 
+int nes_cart::countUnusedBanks() {
+	int count = 0;
+	for (int i = 0; i < cachedBankCount; i++) {
+		if (!isBankUsed(i)) {
+			count++;
+		}
+	}
+	return count;
+}
+
 // returns whether the bank given is in use by the memory map
 bool nes_cart::isBankUsed(int index) {
 	unsigned char* ptr = cache[index].ptr;
 
-	if (ptr == nesPPU.chrPages[0] || ptr == nesPPU.chrPages[1] || ptr + 0x1000 == nesPPU.chrPages[0] || ptr + 0x1000 == nesPPU.chrPages[1])
-		return true;
+	for (int i = 0; i < 8; i++) {
+		if (nesPPU.chrPages[i] >= ptr && nesPPU.chrPages[i] < ptr + 8192)
+			return true;
+	}
 
 	for (int i = 0; i < 4 + isLowPRGROM; i++) {
 		if (programBanks[i] == cache[index].prgIndex) {
@@ -459,22 +743,120 @@ bool nes_cart::isBankUsed(int index) {
 	return false;
 }
 
+// fibonacci hash down to the 9 bits of BANK_HASH_SIZE
+static inline uint32 bankHashSlot(int32 key) {
+	return (uint32(key) * 2654435761u) >> 23;
+}
+
+int nes_cart::findCachedBank(int32 key) {
+	for (uint32 slot = bankHashSlot(key); bankHash[slot].key != -1; slot = (slot + 1) & (BANK_HASH_SIZE - 1)) {
+		if (bankHash[slot].key == key) {
+			return bankHash[slot].location;
+		}
+	}
+	return -1;
+}
+
+void nes_cart::addCachedBank(int32 key, int32 location) {
+	uint32 slot = bankHashSlot(key);
+	while (bankHash[slot].key != -1) {
+		slot = (slot + 1) & (BANK_HASH_SIZE - 1);
+	}
+	bankHash[slot].key = key;
+	bankHash[slot].location = location;
+}
+
+void nes_cart::removeCachedBank(int32 key) {
+	uint32 slot = bankHashSlot(key);
+	while (bankHash[slot].key != key) {
+		DebugAssert(bankHash[slot].key != -1);
+		slot = (slot + 1) & (BANK_HASH_SIZE - 1);
+	}
+
+	// shift later entries of the probe run back so lookups never stop early on the hole
+	uint32 hole = slot;
+	for (slot = (slot + 1) & (BANK_HASH_SIZE - 1); bankHash[slot].key != -1; slot = (slot + 1) & (BANK_HASH_SIZE - 1)) {
+		uint32 home = bankHashSlot(bankHash[slot].key);
+		if (((slot - home) & (BANK_HASH_SIZE - 1)) >= ((slot - hole) & (BANK_HASH_SIZE - 1))) {
+			bankHash[hole] = bankHash[slot];
+			hole = slot;
+		}
+	}
+	bankHash[hole].key = -1;
+}
+
+void nes_cart::touchBank(int index) {
+	if (lruNewest == index) {
+		return;
+	}
+
+	nes_cached_bank& bank = cache[index];
+	cache[bank.lruNewer].lruOlder = bank.lruOlder;
+	if (bank.lruOlder != -1) {
+		cache[bank.lruOlder].lruNewer = bank.lruNewer;
+	} else {
+		lruOldest = bank.lruNewer;
+	}
+
+	bank.lruNewer = -1;
+	bank.lruOlder = lruNewest;
+	cache[lruNewest].lruNewer = index;
+	lruNewest = index;
+}
+
+void nes_cart::resetBankLookup() {
+	for (int i = 0; i < BANK_HASH_SIZE; i++) {
+		bankHash[i].key = -1;
+	}
+
+	lruNewest = -1;
+	lruOldest = -1;
+	chrFillBank = -1;
+	chrFillPage = 0;
+}
+
 // finds least recently requested bank that is currently unused
 int nes_cart::findOldestUnusedBank() {
-	int bestBank = -1;
-	for (int i = 0; i < cachedBankCount; i++) {
-		if (bestBank == -1 || cache[i].request < cache[bestBank].request) {
-			if (isBankUsed(i) == false) {
-				bestBank = i;
-			} else {
-				// mark as "requested" since it obviously is still in use
-				cache[i].request = requestIndex;
-			}
+	DebugAssert(cachedBankCount > 0 && cachedBankCount <= MAX_CACHED_ROM_BANKS);
+
+	// mappers settle cachedBankCount before the first request, so the list is built then (bank 0 is oldest)
+	if (lruNewest == -1) {
+		for (int i = 0; i < cachedBankCount; i++) {
+			cache[i].lruNewer = i + 1 < cachedBankCount ? i + 1 : -1;
+			cache[i].lruOlder = i - 1;
 		}
+		lruNewest = cachedBankCount - 1;
+		lruOldest = 0;
+	}
+
+	int bestBank = lruOldest;
+	for (int i = 0; i < cachedBankCount && bestBank != -1 && isBankUsed(bestBank); i++) {
+		// move to the front since it obviously is still in use
+		int newer = cache[bestBank].lruNewer;
+		touchBank(bestBank);
+		bestBank = newer;
 	}
 
 	// if we have enough caching set up... this shouldn't happen
-	DebugAssert(bestBank != -1);
+	DebugAssert(bestBank != -1 && !isBankUsed(bestBank));
+
+	// drop whatever the bank held from the lookup
+	nes_cached_bank& bank = cache[bestBank];
+	if (bank.prgIndex == CHR_CACHE_INDEX) {
+		for (int32 page = 0; page < 8 && bank.chrIndex[page] != -1; page++) {
+			removeCachedBank(CHR_PAGE_KEY(bank.chrIndex[page]));
+		}
+		if (chrFillBank == bestBank) {
+			chrFillBank = -1;
+		}
+		bankStats.evictions++;
+	} else if (bank.prgIndex >= 0) {
+		removeCachedBank(bank.prgIndex);
+		bankStats.evictions++;
+	}
+	bank.prgIndex = -2;
+
+	touchBank(bestBank);
 	return bestBank;
 }
 
@@ -482,74 +864,197 @@ int nes_cart::findOldestUnusedBank() {
 unsigned char* nes_cart::cachePRGBank(int index) {
 	DebugAssert(index < numPRGBanks * 2);
 
-	requestIndex++;
+#if DIRECT_ROM_MAPPING
+	if (romData) {
+		return romData + 16 + 8192 * index;
+	}
+#endif
 
-	// find bank index within range:
-	for (int i = 0; i < cachedBankCount; i++) {
-		if (cache[i].prgIndex == index) {
-			cache[i].request = requestIndex;
-			return cache[i].ptr;
-		}
+	int location = findCachedBank(index);
+	if (location != -1) {
+		bankStats.hits++;
+		touchBank(location >> 3);
+		return cache[location >> 3].ptr;
 	}
 
-	// replace smallest request with inactive memory
+	bankStats.misses++;
+	return loadPRGBank(index);
+}
+
+unsigned char* nes_cart::loadPRGBank(int index) {
+	// replace least recently requested with inactive memory
 	int replaceIndex = findOldestUnusedBank();
 	cache[replaceIndex].prgIndex = index;
-	cache[replaceIndex].request = requestIndex;
+	cache[replaceIndex].patchedSlots = 0;
+	cache[replaceIndex].invalidatePredecode();
+	addCachedBank(index, replaceIndex * 8);
 	BlockRead(cache[replaceIndex].ptr, 8192, 16 + 8192 * index);
 	return cache[replaceIndex].ptr;
 }
 
-// caches an 8 KB CHR bank, returns result bank memory pointer
-unsigned char* nes_cart::cacheCHRBank(int16* indices) {
-	int chrBankMask = (numCHRBanks << 3) - 1;
-	indices[0] &= chrBankMask;
-	indices[1] &= chrBankMask;
-	indices[2] &= chrBankMask;
-	indices[3] &= chrBankMask;
-	indices[4] &= chrBankMask;
-	indices[5] &= chrBankMask;
-	indices[6] &= chrBankMask;
-	indices[7] &= chrBankMask;
-
-	requestIndex++;
-
-	// find bank index within range:
-	const int cacheIndex = 4096;
+// caches a 1 KB CHR bank, returns result page memory pointer
+unsigned char* nes_cart::cacheCHRPage(int index) {
+	index &= (numCHRBanks << 3) - 1;
+
+#if DIRECT_ROM_MAPPING
+	if (romData) {
+		return romData + 16 + 16384 * numPRGBanks + 1024 * index;
+	}
+#endif
+
+	int location = findCachedBank(CHR_PAGE_KEY(index));
+	if (location != -1) {
+		bankStats.hits++;
+		touchBank(location >> 3);
+		return cache[location >> 3].ptr + 1024 * (location & 7);
+	}
+
+	bankStats.misses++;
+	return loadCHRPage(index);
+}
+
+unsigned char* nes_cart::loadCHRPage(int index) {
+	// pages are filled in order, so only the newest CHR bank can have empty pages. Once it is full the least
+	// recently requested bank is replaced entirely with 8 empty pages
+	if (chrFillBank == -1 || chrFillPage == 8) {
+		chrFillBank = findOldestUnusedBank();
+		chrFillPage = 0;
+
+		nes_cached_bank& bank = cache[chrFillBank];
+		bank.prgIndex = CHR_CACHE_INDEX;
+		bank.invalidatePredecode();
+		memset(bank.chrIndex, 0xFF, sizeof(bank.chrIndex));
+#if DECODED_TILE_CACHE
+		nesPPU.invalidateDecodedTiles(bank.ptr, 8192);
+#endif
+	}
+
+	nes_cached_bank& bank = cache[chrFillBank];
+	bank.chrIndex[chrFillPage] = index;
+	addCachedBank(CHR_PAGE_KEY(index), chrFillBank * 8 + chrFillPage);
+	touchBank(chrFillBank);
+
+	unsigned char* result = bank.ptr + 1024 * chrFillPage;
+	chrFillPage++;
+	BlockRead(result, 1024, 16 + 16384 * numPRGBanks + 1024 * index);
+	return result;
+}
+
+static inline uint32 bankHistorySlot(int32 key) {
+	return (uint32(key) * 2654435761u) >> 24;
+}
+
+void nes_cart::recordNextBank(int32 key, int32 nextKey) {
+	nes_bank_history_entry& entry = bankHistory[bankHistorySlot(key)];
+	entry.key = key;
+	entry.next = nextKey;
+}
+
+int32 nes_cart::predictNextBank(int32 key) {
+	const nes_bank_history_entry& entry = bankHistory[bankHistorySlot(key)];
+	return entry.key == key ? entry.next : -1;
+}
+
+void nes_cart::PrefetchBanks() {
+#if BANK_PREFETCH_BUDGET
+#if DIRECT_ROM_MAPPING
+	if (romData) {
+		return;
+	}
+#endif
+
+	// only prefetch into spare room, since scattering mapped CHR pages over many banks could leave a real miss
+	// with nothing to replace
+	if (cachedBankCount == 0 || countUnusedBanks() <= cachedBankCount / 2) {
+		return;
+	}
+
+	int budget = BANK_PREFETCH_BUDGET;
+
+	// CHR pages first since they are cheap and usually switch more often
+	if (numCHRBanks) {
+		int chrBankMask = (numCHRBanks << 3) - 1;
+		for (int32 i = 0; i < 8 && budget >= 1024; i++) {
+			int32 next = predictNextBank(CHR_PAGE_KEY(chrBanks[i] & chrBankMask));
+			if (next != -1 && findCachedBank(next) == -1) {
+				loadCHRPage(next & 0xFFFF);
+				bankStats.prefetches++;
+				budget -= 1024;
+
+				if (countUnusedBanks() <= cachedBankCount / 2) {
+					return;
+				}
+			}
+		}
+	}
+
+	for (int32 i = 0; i < 4 + isLowPRGROM && budget >= 8192; i++) {
+		int32 next = programBanks[i] >= 0 ? predictNextBank(programBanks[i]) : -1;
+		if (next != -1 && findCachedBank(next) == -1) {
+			loadPRGBank(next);
+			bankStats.prefetches++;
+			budget -= 8192;
+
+			if (countUnusedBanks() <= cachedBankCount / 2) {
+				return;
+			}
+		}
+	}
+#endif
+}
+
+uint32* nes_cart::getPredecodeRecords(unsigned char* bankPtr) {
+#if DIRECT_ROM_MAPPING
+	if (romData && bankPtr >= romData && bankPtr < romData + romSize) {
+		uint32*& records = romPredecode[(bankPtr - romData - 16) >> 13];
+		if (!records) {
+			records = (uint32*) calloc(8192, sizeof(uint32));
+		}
+		return records;
+	}
+#endif
+
 	for (int i = 0; i < cachedBankCount; i++) {
-		if (cache[i].prgIndex == cacheIndex) {
-			nes_cached_bank& bank = cache[i];
-			if (bank.chrIndex[0] == indices[0] && bank.chrIndex[1] == indices[1] &&
-				bank.chrIndex[2] == indices[2] && bank.chrIndex[3] == indices[3] &&
-				bank.chrIndex[4] == indices[4] && bank.chrIndex[5] == indices[5] &&
-				bank.chrIndex[6] == indices[6] && bank.chrIndex[7] == indices[7])
-			{
-				bank.request = requestIndex;
-				return bank.ptr;
+		if (cache[i].ptr == bankPtr) {
+			if (!cache[i].predecode) {
+				cache[i].predecode = (uint32*) calloc(8192, sizeof(uint32));
 			}
+			return cache[i].predecode;
 		}
 	}
 
-	// replace smallest request entirely (no inactive memory for CHR ROM since they are copied to PPU mem directly)
-	int replaceIndex = findOldestUnusedBank();
-	nes_cached_bank& bank = cache[replaceIndex];
-	bank.prgIndex = cacheIndex;
-	bank.request = requestIndex;
-	for (int32 i = 0; i < 8; i++) {
-		bank.chrIndex[i] = indices[i];
-		BlockRead(bank.ptr + 1024 * i, 1024, 16 + 16384 * numPRGBanks + 1024 * indices[i]);
+	return NULL;
+}
+
+bool nes_cart::holdsSameBank(int index, const nes_cached_bank& copy) {
+	if (cache[index].prgIndex != copy.prgIndex) {
+		return false;
 	}
-	return bank.ptr;
+
+	// pages of a CHR bank are filled one at a time
+	return copy.prgIndex != CHR_CACHE_INDEX || !memcmp(cache[index].chrIndex, copy.chrIndex, sizeof(copy.chrIndex));
 }
 
-// caches a single 8 KB CHR bank based on the 8 KB index, returns result bank memory pointer
-unsigned char* nes_cart::cacheSingleCHRBank(int16 index) {
-	int16 indices[8] = {
-		index * 8 + 0, index * 8 + 1, index * 8 + 2, index * 8 + 3,
-		index * 8 + 4, index * 8 + 5, index * 8 + 6, index * 8 + 7
-	};
+unsigned char* nes_cart::relocateBankPointer(unsigned char* ptr, const nes_cached_bank* copies) {
+	for (int i = 0; i < cachedBankCount; i++) {
+		if (ptr >= cache[i].ptr && ptr < cache[i].ptr + 8192) {
+			if (holdsSameBank(i, copies[i])) {
+				return ptr;
+			}
 
-	return cacheCHRBank(indices);
+			unsigned int offset = ptr - cache[i].ptr;
+			if (copies[i].prgIndex == CHR_CACHE_INDEX) {
+				int page = copies[i].chrIndex[offset >> 10];
+				return page >= 0 ? cacheCHRPage(page) + (offset & 1023) : ptr;
+			} else if (copies[i].prgIndex >= 0) {
+				return cachePRGBank(copies[i].prgIndex) + offset;
+			}
+			return ptr;
+		}
+	}
+
+	// RAM or the mapped ROM file, which never move
+	return ptr;
 }
 
 void nes_cart::MapProgramBanks(int32 toBank, int32 cartBank, int32 numBanks) {
@@ -557,29 +1062,76 @@ void nes_cart::MapProgramBanks(int32 toBank, int32 cartBank, int32 numBanks) {
 
 	const unsigned int addrTarget[5] = {0x80, 0xA0, 0xC0, 0xE0, 0x60};
 
-	bool bDidRemap = false;
+	uint8 remappedSlots = 0;
 
 	for (int32 i = 0; i < numBanks; i++) {
 		const int32 destBank = i + toBank;
 		if (programBanks[destBank] != cartBank + i) {
+			if (programBanks[destBank] >= 0) {
+				recordNextBank(programBanks[destBank], cartBank + i);
+			}
 			programBanks[destBank] = cartBank + i;
-			mainCPU.setMapKB(addrTarget[destBank], 8, cachePRGBank(cartBank + i));
-			bDidRemap = true;
+			unsigned char* bankPtr = cachePRGBank(cartBank + i);
+			mainCPU.setMapKB(addrTarget[destBank], 8, bankPtr);
+#if PREDECODE_INSTRUCTIONS
+			mainCPU.predecode[addrTarget[destBank] >> 5] = getPredecodeRecords(bankPtr);
+#endif
+			remappedSlots |= 1 << destBank;
 		}
 	}
 
-	if (bDidRemap) {
-		// game genie codes
-		for (int code = 0; code < 10; code++) {
-			if (nesSettings.codes[code].isActive()) {
-				unsigned int addr = nesSettings.codes[code].getEffAddr();
-				uint8 setValue = nesSettings.codes[code].getSetValue();
-				unsigned char* memValue = mainCPU.getNonIOMem(addr);
-				if ((size_t) memValue >= 0x10000 && (nesSettings.codes[code].doCompare() == false || nesSettings.codes[code].getCmpValue() == *memValue)) {
-					*memValue = setValue;
+	if (remappedSlots & slotPatchMask) {
+		applySlotPatches(remappedSlots);
+	}
+}
+
+void nes_cart::BuildGameGeniePatches() {
+	numSlotPatches = 0;
+	slotPatchMask = 0;
+
+	for (int code = 0; code < 10 && nesSettings.codes[code].isActive(); code++) {
+		const GameGenieCode& gg = nesSettings.codes[code];
+
+		// codes always have the top address bit set, so this is one of the 4 PRG slots
+		nes_gg_patch patch;
+		patch.addr = gg.getEffAddr();
+		patch.set = gg.getSetValue();
+		patch.cmp = gg.getCmpValue();
+		patch.bCompare = gg.doCompare();
+		slotPatches[numSlotPatches++] = patch;
+		slotPatchMask |= 1 << ((patch.addr - 0x8000) >> 13);
+	}
+}
+
+void nes_cart::applySlotPatches(uint8 remappedSlots) {
+	uint8 patchSlots = remappedSlots & slotPatchMask;
+
+#if DIRECT_ROM_MAPPING
+	// the mapped file has no cache entries to remember patched slots, the compare keeps a repeat from doing harm
+	if (!romData)
+#endif
+	{
+		for (int32 slot = 0; slot < 4; slot++) {
+			int location = (patchSlots & (1 << slot)) && programBanks[slot] >= 0 ? findCachedBank(programBanks[slot]) : -1;
+			if (location != -1) {
+				nes_cached_bank& bank = cache[location >> 3];
+				if (bank.patchedSlots & (1 << slot)) {
+					patchSlots &= ~(1 << slot);
 				}
-			} else {
-				break;
+				bank.patchedSlots |= 1 << slot;
+			}
+		}
+	}
+
+	for (int i = 0; i < numSlotPatches && patchSlots; i++) {
+		unsigned int addr = slotPatches[i].addr;
+		if (patchSlots & (1 << ((addr - 0x8000) >> 13))) {
+			unsigned char* memValue = mainCPU.getNonIOMem(addr);
+			if ((size_t) memValue >= 0x10000 && (!slotPatches[i].bCompare || *memValue == slotPatches[i].cmp)) {
+				*memValue = slotPatches[i].set;
+#if PREDECODE_INSTRUCTIONS
+				mainCPU.invalidatePredecoded(addr);
+#endif
 			}
 		}
 	}
@@ -588,14 +1140,12 @@ void nes_cart::MapProgramBanks(int32 toBank, int32 cartBank, int32 numBanks) {
 void nes_cart::CommitChrBanks() {
 	DebugAssert(numCHRBanks); // should not happen with CHR RAM
 
-	uint8* bankData = cacheCHRBank(chrBanks);
-
-	if (bSwapChrPages) {
-		nesPPU.chrPages[0] = bankData + 0x1000;
-		nesPPU.chrPages[1] = bankData;
-	} else {
-		nesPPU.chrPages[0] = bankData;
-		nesPPU.chrPages[1] = bankData + 0x1000;
+	// each 1 KB page is cached on its own, so a single bank switch costs at most one 1 KB read
+	int chrBankMask = (numCHRBanks << 3) - 1;
+	const int swapPages = bSwapChrPages ? 4 : 0;
+	for (int32 i = 0; i < 8; i++) {
+		chrBanks[i] &= chrBankMask;
+		nesPPU.chrPages[i ^ swapPages] = cacheCHRPage(chrBanks[i]);
 	}
 	
 	bDirtyChrBanks = false;
@@ -607,6 +1157,10 @@ void nes_cart::MapCharacterBanks(int32 toBank, int32 cartBank, int32 numBanks) {
 	for (int32 i = 0; i < numBanks; i++) {
 		const int32 destBank = i + toBank;
 		if (chrBanks[destBank] != cartBank + i) {
+			if (numCHRBanks) {
+				int chrBankMask = (numCHRBanks << 3) - 1;
+				recordNextBank(CHR_PAGE_KEY(chrBanks[destBank] & chrBankMask), CHR_PAGE_KEY((cartBank + i) & chrBankMask));
+			}
 			chrBanks[destBank] = cartBank + i;
 			bDirtyChrBanks = true;
 		}
@@ -650,19 +1204,3 @@ bool nes_cart::IRQReached() {
 
 	return true;
 }
-
-void nes_cart::rollbackClocks(unsigned int clockCount) {
-	if (mapper == 4) {
-		MMC3_IRQ_LASTSET -= clockCount;
-	} else if (mapper == 64) {
-		if (Mapper64_IRQ_CLOCKS) {
-			Mapper64_IRQ_CLOCKS -= clockCount;
-		}
-	} else if (mapper == 67) {
-		Mapper67_IRQ_LastSet -= clockCount;
-	} else if (mapper == 69) {
-		if (Mapper69_LASTCOUNTERCLK) {
-			Mapper69_LASTCOUNTERCLK -= clockCount;
-		}
-	}
-}
\ No newline at end of file
@@ -5,7 +5,7 @@
 #include "debug.h"
 #include "nes.h"
 
-nes_cpu mainCPU ALIGN(256);
+MACHINE_STATE nes_cpu mainCPU ALIGN(256);
 
 void nes_cpu::latchedSpecial(unsigned int addr) {
 	if (addr == 0x4015) {
@@ -46,8 +46,24 @@ void nes_cpu::writeSpecial(unsigned int addr, unsigned char value) {
 	}
 }
 
+#if PREDECODE_INSTRUCTIONS
+uint32 nes_cpu::fillPredecoded(uint32* records) {
+	uint32 record = decodeInstruction(PC);
+
+	// the last two bytes of a window can have operands in the next window, which may be remapped independently
+	if ((PC & 0x1FFF) < 0x1FFE) {
+		records[PC & 0x1FFF] = record;
+	}
+
+	return record;
+}
+#endif
+
 void nes_cpu::mapDefaults() {
 	memset(_map, 0, sizeof(_map));
+#if PREDECODE_INSTRUCTIONS
+	memset(predecode, 0, sizeof(predecode));
+#endif
 
 	// 0x0000 - 0x2000 is RAM and its mirrors
 	for (int m = 0x00; m < 0x20; m++) {
@@ -85,6 +101,12 @@ void nes_cpu::reset() {
 	Y = 0;
 	P = 0;
 
+	// flags are resolved into P when the reset interrupt pushes it, so these are cleared as on a fresh start rather
+	// than left from the last game (power on RAM would differ, which movies check)
+	carryResult = 0;
+	zeroResult = 0;
+	negativeResult = 0;
+
 	PC = 0x0002;
 	SP = 0xFD;
 
@@ -102,6 +124,7 @@ void nes_cpu::reset() {
 	irqClock[1] = 0;
 	irqClock[2] = 0;
 	irqClock[3] = 0;
+	scheduleEvents();
 
 	// trigger reset interrupt
 	cpu6502_SoftwareInterrupt(0xFFFC);
@@ -121,19 +144,32 @@ void cpu6502_IRQ(int irqBit) {
 	}
 }
 
-void nes_cpu::syncClocks() {
-	// at a billion cycles, reduve by 500m cycles
-	const unsigned int highThresh =  1000000000;
-	const unsigned int reduction = 500000000;
-	if (clocks > highThresh) {
-		clocks -= reduction;
-		nextClocks -= reduction;
-		ppuClocks -= reduction;
-		apuClocks -= reduction;
-		if (irqClock[0]) irqClock[0] -= reduction;
-		if (irqClock[1]) irqClock[0] -= reduction;
-		if (irqClock[2]) irqClock[0] -= reduction;
-
-		nesCart.rollbackClocks(reduction);
+void nes_cpu::scheduleEvents() {
+	events.clear();
+	events.schedule(CPU_EVENT_PPU, ppuClocks);
+	events.schedule(CPU_EVENT_APU, apuClocks);
+	for (int i = 0; i < 4; i++) {
+		if (irqMask & (1 << i)) {
+			events.schedule(CPU_EVENT_IRQ + i, irqClock[i]);
+		}
+	}
+}
+
+void nes_cpu::dispatchDueEvents() {
+	if (clocks >= ppuClocks) {
+		nesPPU.step();
+		events.schedule(CPU_EVENT_PPU, ppuClocks);
+	}
+	if (clocks >= apuClocks) {
+		nesAPU.step();
+		events.schedule(CPU_EVENT_APU, apuClocks);
+	}
+
+	// both APU and PPU can trigger an immediate IRQ
+	if (irqMask) {
+		if ((irqMask & 1) && clocks >= irqClock[0]) cpu6502_IRQ(0);
+		else if ((irqMask & 2) && clocks >= irqClock[1]) cpu6502_IRQ(1);
+		else if ((irqMask & 4) && clocks >= irqClock[2]) cpu6502_IRQ(2);
+		else if ((irqMask & 8) && clocks >= irqClock[3]) cpu6502_IRQ(3);
 	}
 }
\ No newline at end of file
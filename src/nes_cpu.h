@@ -1,17 +1,17 @@
 #pragma once
 // inlined header file for cpu_6502 sub-struct so we can include NES specific functionality
 
-extern unsigned char openBus[256];
+extern MACHINE_STATE unsigned char openBus[256];
 
 struct nes_cpu : public cpu_6502 {
 	// each 8 KB page access is stored to determine if we need to effect hardware from a read
 	unsigned int accessTable[8];
 
 	// clocks for next PPU update
-	unsigned int ppuClocks;
+	uint64 ppuClocks;
 
 	// clocks for next APU update
-	unsigned int apuClocks;
+	uint64 apuClocks;
 
 	// indicates that an NMI should occur on completion of next cpu instruction
 	bool ppuNMI;
@@ -29,6 +29,46 @@ struct nes_cpu : public cpu_6502 {
 	// memory map for special address (mirrored from 0x4000 to 0x6000)
 	unsigned char specialMemory[256];
 
+#if PREDECODE_INSTRUCTIONS
+	// instruction records (opcode | operand1 << 8 | operand2 << 16 | PREDECODE_VALID) indexed by PC for each 8 KB
+	// window mapped to a cached PRG bank. NULL for RAM and everything else, which is always decoded directly
+	uint32* predecode[8];
+
+	#define PREDECODE_VALID 0x1000000
+
+	FORCE_INLINE uint32 decodeInstruction(unsigned int addr) {
+		unsigned int addr1 = (addr + 1) & 0xFFFF;
+		unsigned int addr2 = (addr + 2) & 0xFFFF;
+		return PREDECODE_VALID | _map[addr >> 8][addr] | (_map[addr1 >> 8][addr1] << 8) | (_map[addr2 >> 8][addr2] << 16);
+	}
+
+	// returns the record for the instruction at PC, decoding it on first execution
+	FORCE_INLINE uint32 fetchInstruction() {
+		uint32* records = predecode[PC >> 13];
+		if (records) {
+			uint32 record = records[PC & 0x1FFF];
+			if (record) {
+				return record;
+			}
+			return fillPredecoded(records);
+		}
+		return decodeInstruction(PC);
+	}
+
+	uint32 fillPredecoded(uint32* records);
+
+	// clears the records of any instruction that could include the byte at addr
+	FORCE_INLINE void invalidatePredecoded(unsigned int addr) {
+		uint32* records = predecode[addr >> 13];
+		if (records) {
+			unsigned int offset = addr & 0x1FFF;
+			records[offset] = 0;
+			if (offset >= 1) records[offset - 1] = 0;
+			if (offset >= 2) records[offset - 2] = 0;
+		}
+	}
+#endif
+
 	FORCE_INLINE unsigned char read(unsigned int addr) {
 		accessTable[addr >> 13] = addr;
 		return _map[addr >> 8][addr];
@@ -55,10 +95,19 @@ struct nes_cpu : public cpu_6502 {
 		_map[addr >> 8][addr] = value;
 	}
 
+	// for mapper writes to 0x6000 - 0x7FFF that reach cart RAM, so only those make the .sav file dirty
+	FORCE_INLINE void writeWRAM(unsigned int addr, unsigned char value) {
+		nesCart.markWRAMDirty(addr);
+		_map[addr >> 8][addr] = value;
+	}
+
 	// inline mapping helpers
 	FORCE_INLINE void setMap(unsigned int startAddrHigh, unsigned int numBlocks, unsigned char* ptr) {
 		// 256 byte increments
 		for (unsigned int i = 0; i < numBlocks; i++) {
+#if PREDECODE_INSTRUCTIONS
+			predecode[startAddrHigh >> 5] = NULL;
+#endif
 			_map[startAddrHigh] = &ptr[i * 0x100] - (startAddrHigh << 8);
 			startAddrHigh++;
 		}
@@ -66,6 +115,9 @@ struct nes_cpu : public cpu_6502 {
 
 	FORCE_INLINE void setMapOpenBus(unsigned int startAddrHigh, unsigned int numBlocks) {
 		for (unsigned int i = 0; i < numBlocks; i++) {
+#if PREDECODE_INSTRUCTIONS
+			predecode[startAddrHigh >> 5] = NULL;
+#endif
 			_map[startAddrHigh] = openBus - (startAddrHigh << 8);
 			startAddrHigh++;
 		}
@@ -103,6 +155,15 @@ struct nes_cpu : public cpu_6502 {
 	// reset the CPU (assumes memory mapping is set up properly for this)
 	void reset();
 
-	// synchronizes the various clock counters down to avoid 32 bit wraparound
-	void syncClocks();
+	// rebuilds the event queue from ppuClocks, apuClocks and the pending IRQs
+	void scheduleEvents();
+
+	// runs the PPU, APU and IRQs that are due after a cpu6502_Step
+	FORCE_INLINE void dispatchEvents() {
+		if (clocks >= events.deadline(true)) {
+			dispatchDueEvents();
+		}
+	}
+
+	void dispatchDueEvents();
 };
@@ -7,7 +7,7 @@
 #include "settings.h"
 #include "nes_cpu.h"
 
-#if !TARGET_WINSIM
+#if TARGET_PRIZM
 // returns true if the key is down, false if up
 bool keyDown_fast(unsigned char keyCode) {
 	static const unsigned short* keyboard_register = (unsigned short*)0xA44B0000;
@@ -21,10 +21,10 @@ bool keyDown_fast(unsigned char keyCode) {
 }
 #endif
 
-unsigned char curStrobe = 0;
-unsigned int buttonMarch1 = 0;
-unsigned int buttonMarch2 = 0;
-bool isDown[NES_MAX_KEYS];
+MACHINE_STATE unsigned char curStrobe = 0;
+MACHINE_STATE unsigned int buttonMarch1 = 0;
+MACHINE_STATE unsigned int buttonMarch2 = 0;
+MACHINE_STATE bool isDown[NES_MAX_KEYS];
 
 void input_cacheKeys() {
 	for (int buttonNo = 0; buttonNo < NES_MAX_KEYS; buttonNo++) {
@@ -39,6 +39,8 @@ void input_cacheKeys() {
 		if (isDown[NES_P1_TURBO_A]) isDown[NES_P1_A] = true;
 		if (isDown[NES_P1_TURBO_B]) isDown[NES_P1_B] = true;
 	}
+
+	nesMovie.cacheKeys();
 }
 
 inline unsigned char readButton(int buttonNo) {
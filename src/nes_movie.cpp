@@ -0,0 +1,339 @@
+
+// Input movie recording and playback (see nes_movie in nes.h)
+
+#include "platform.h"
+#include "debug.h"
+#include "nes.h"
+#include "settings.h"
+
+extern MACHINE_STATE bool isDown[NES_MAX_KEYS];
+extern MACHINE_STATE char scanlineClocks[245];
+
+MACHINE_STATE nes_movie nesMovie;
+
+// fields are little endian in the file, so movies recorded on the calculator play on the host
+struct nes_movie_header {
+	char magic[4];
+	uint32 version;
+	uint32 romHash;
+	uint32 anchorHash;
+	uint32 anchor;
+	uint32 numFrames;
+};
+
+static void SetMovieName(const char* romFile, uint16* intoName, int32 nameSize) {
+	char movieFile[256];
+	strcpy(movieFile, romFile);
+	*(strrchr(movieFile, '.') + 1) = 0;
+	strcat(movieFile, "nzm");
+
+	Bfile_StrToName_ncpy(intoName, movieFile, nameSize - 1);
+}
+
+// hash of the ROM data as stored in the file (before Game Genie patches)
+static uint32 HashROM() {
+	// reading the ROM here is not part of emulation, so it stays out of the cache stats
+	const nes_bank_stats stats = nesCart.bankStats;
+
+	int size = nesCart.numPRGBanks * 16384 + nesCart.numCHRBanks * 8192;
+	if (nesCart.chunkOffsets) {
+		size = min(size, nesCart.romDataSize);
+	} else {
+		size = min(size, Bfile_GetFileSize_OS(nesCart.handle) - 16);
+	}
+
+	uint32 hash = 0x13371337 + nesCart.mapper;
+	uint8 buffer[1024];
+	for (int offset = 0; offset < size; offset += sizeof(buffer)) {
+		const int toRead = min(size - offset, (int) sizeof(buffer));
+		nesCart.BlockRead(buffer, toRead, 16 + offset);
+		for (int i = 0; i < toRead; i++) {
+			hash = hash * 31 + buffer[i];
+		}
+	}
+
+	nesCart.bankStats = stats;
+	return hash;
+}
+
+// hash of CPU RAM and cart RAM, which tells apart the starting points a movie could be played from
+static uint32 HashRAM() {
+	uint32 hash = 0x13371337;
+	for (int i = 0; i < 0x800; i++) {
+		hash = hash * 31 + mainCPU.RAM[i];
+	}
+	// cart RAM sits at the end of cache[], the ROM banks before it that are not filled yet hold whatever ran before
+	for (int bank = nesCart.availableROMBanks; bank < nesCart.allocatedROMBanks; bank++) {
+		const uint8* data = nesCart.cache[bank].ptr;
+		for (int i = 0; i < 8192; i++) {
+			hash = hash * 31 + data[i];
+		}
+	}
+	return hash;
+}
+
+// puts the machine at the anchor, false if it can't be reached from here
+static bool GoToAnchor(MovieAnchor anchor, bool bRecording) {
+	if (anchor == MA_PowerOn) {
+		if (nesPPU.frameCounter != 0) {
+			printf("Movie must start at power on");
+			return false;
+		}
+		return true;
+	}
+
+	// recording goes on from the loaded save state rather than the machine it was written from, so it starts from
+	// exactly what playback will
+	if (bRecording) {
+		if (!nesCart.SaveState()) {
+			printf("Could not write movie save state");
+			return false;
+		}
+		nesCart.BuildFileBlocks();
+	}
+
+	// save states hold neither the APU nor where the CPU is within the scanline, so both start over the same way each
+	// time the anchor is reached (states load between frames, with the PPU step for scanline 243 next). The clock
+	// parity decides OAM DMA timing, so it is evened up first in case the mapper times anything from it
+	mainCPU.clocks += mainCPU.clocks & 1;
+
+	if (!nesCart.LoadState()) {
+		printf("Could not load movie save state");
+		return false;
+	}
+
+	nesAPU.init();
+	mainCPU.ackIRQ(1);
+	mainCPU.ackIRQ(2);
+	mainCPU.ppuClocks = mainCPU.clocks + scanlineClocks[242];
+	mainCPU.scheduleEvents();
+	nesAPU.writeReg(0x17, 0);
+	return true;
+}
+
+bool nes_movie::StartRecording(MovieAnchor withAnchor) {
+	Stop();
+
+	if (!frames) {
+		frames = (uint8*) malloc(MOVIE_MAX_FRAMES * 2);
+		if (!frames) {
+			printf("No memory for movie");
+			return false;
+		}
+	}
+
+	if (!GoToAnchor(withAnchor, true)) {
+		return false;
+	}
+
+	anchor = withAnchor;
+	romHash = HashROM();
+	anchorHash = HashRAM();
+	numFrames = 0;
+	bRecording = true;
+
+	// the input read this frame is the first the game sees from the anchor
+	recordFrame();
+	return true;
+}
+
+bool nes_movie::StartPlayback() {
+	Stop();
+
+	if (!readFile()) {
+		return false;
+	}
+
+	if (romHash != HashROM()) {
+		printf("Movie is for a different ROM");
+		return false;
+	}
+
+	if (!GoToAnchor(anchor, false)) {
+		return false;
+	}
+
+	// a different .sav or save state would play out differently
+	if (anchorHash != HashRAM()) {
+		printf("Movie starts from different RAM");
+		return false;
+	}
+
+	curFrame = 0;
+	bPlaying = true;
+	playFrame();
+	return true;
+}
+
+void nes_movie::Stop() {
+	if (bRecording) {
+		bRecording = false;
+		if (!writeFile()) {
+			printf("Could not write movie");
+		}
+	}
+	bPlaying = false;
+}
+
+void nes_movie::cacheKeys() {
+	if (bRecording) {
+		recordFrame();
+	} else if (bPlaying) {
+		playFrame();
+	}
+}
+
+void nes_movie::recordFrame() {
+	if (numFrames == MOVIE_MAX_FRAMES) {
+		printf("Movie is full");
+		Stop();
+		return;
+	}
+
+	uint8 p1 = 0;
+	uint8 p2 = 0;
+	for (int i = 0; i < 8; i++) {
+		p1 |= isDown[NES_P1_A + i] << i;
+		p2 |= isDown[NES_P2_A + i] << i;
+	}
+	frames[numFrames * 2 + 0] = p1;
+	frames[numFrames * 2 + 1] = p2;
+	numFrames++;
+
+	// going back in time would leave the recording behind
+	isDown[NES_REWIND] = false;
+	isDown[NES_LOADSTATE] = false;
+}
+
+void nes_movie::playFrame() {
+	if (curFrame == numFrames) {
+		// the movie is over, the keys take back over
+		bPlaying = false;
+		return;
+	}
+
+	const uint8 p1 = frames[curFrame * 2 + 0];
+	const uint8 p2 = frames[curFrame * 2 + 1];
+	for (int i = 0; i < 8; i++) {
+		isDown[NES_P1_A + i] = (p1 >> i) & 1;
+		isDown[NES_P2_A + i] = (p2 >> i) & 1;
+	}
+	curFrame++;
+
+	isDown[NES_REWIND] = false;
+	isDown[NES_LOADSTATE] = false;
+}
+
+void nes_movie::step() {
+	static MACHINE_STATE bool bWasRecordDown = false;
+	if (nesSettings.CheckCachedKey(NES_MOVIE_RECORD)) {
+		if (!bWasRecordDown) {
+			if (bRecording) {
+				Stop();
+			} else if (!bPlaying) {
+				StartRecording(MA_SaveState);
+			}
+		}
+		bWasRecordDown = true;
+	} else {
+		bWasRecordDown = false;
+	}
+
+	static MACHINE_STATE bool bWasPlayDown = false;
+	if (nesSettings.CheckCachedKey(NES_MOVIE_PLAY)) {
+		if (!bWasPlayDown) {
+			if (bPlaying) {
+				Stop();
+			} else if (!bRecording) {
+				StartPlayback();
+			}
+		}
+		bWasPlayDown = true;
+	} else {
+		bWasPlayDown = false;
+	}
+}
+
+bool nes_movie::writeFile() {
+	nes_movie_header header;
+	memcpy(header.magic, "NZMV", 4);
+	header.version = MOVIE_VERSION;
+	header.romHash = romHash;
+	header.anchorHash = anchorHash;
+	header.anchor = anchor;
+	header.numFrames = numFrames;
+	EndianSwap_Little(header.version);
+	EndianSwap_Little(header.romHash);
+	EndianSwap_Little(header.anchorHash);
+	EndianSwap_Little(header.anchor);
+	EndianSwap_Little(header.numFrames);
+
+	uint16 movieName[256];
+	SetMovieName(nesCart.romFile, movieName, 256);
+
+	// the size is set on creation, so any older movie goes first
+	Bfile_DeleteEntry(movieName);
+
+	size_t size = sizeof(header) + numFrames * 2;
+	if (Bfile_CreateEntry_OS(movieName, CREATEMODE_FILE, &size) != 0) {
+		return false;
+	}
+
+	int fileID = Bfile_OpenFile_OS(movieName, WRITE, 0);
+	if (fileID < 0) {
+		return false;
+	}
+
+	Bfile_WriteFile_OS(fileID, &header, sizeof(header));
+	Bfile_WriteFile_OS(fileID, frames, numFrames * 2);
+	Bfile_CloseFile_OS(fileID);
+
+	// writing a file moves flash around, so block addresses need to be rebuilt like after a save state
+	nesCart.BuildFileBlocks();
+	return true;
+}
+
+bool nes_movie::readFile() {
+	uint16 movieName[256];
+	SetMovieName(nesCart.romFile, movieName, 256);
+
+	int fileID = Bfile_OpenFile_OS(movieName, READ, 0);
+	if (fileID < 0) {
+		printf("No movie for this ROM");
+		return false;
+	}
+
+	nes_movie_header header;
+	bool bValid = Bfile_ReadFile_OS(fileID, &header, sizeof(header), 0) == sizeof(header);
+	EndianSwap_Little(header.version);
+	EndianSwap_Little(header.romHash);
+	EndianSwap_Little(header.anchorHash);
+	EndianSwap_Little(header.anchor);
+	EndianSwap_Little(header.numFrames);
+
+	bValid = bValid && !memcmp(header.magic, "NZMV", 4) && header.version == MOVIE_VERSION &&
+		header.anchor <= MA_SaveState && header.numFrames <= MOVIE_MAX_FRAMES;
+
+	if (bValid && !frames) {
+		frames = (uint8*) malloc(MOVIE_MAX_FRAMES * 2);
+		if (!frames) {
+			printf("No memory for movie");
+			Bfile_CloseFile_OS(fileID);
+			return false;
+		}
+	}
+
+	bValid = bValid && Bfile_ReadFile_OS(fileID, frames, header.numFrames * 2, -1) == (int) header.numFrames * 2;
+	Bfile_CloseFile_OS(fileID);
+
+	if (!bValid) {
+		printf("Not a movie file");
+		return false;
+	}
+
+	romHash = header.romHash;
+	anchorHash = header.anchorHash;
+	anchor = (MovieAnchor) header.anchor;
+	numFrames = header.numFrames;
+	return true;
+}
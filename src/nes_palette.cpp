@@ -29,9 +29,9 @@ extern const uint8 classicPalette[64 * 3];
 extern const uint8 smoothFBXPalette[64 * 3];
 
 const uint8* GetCustomPalette() {
-	static uint8 customPalette[64 * 3];
-	static bool customPaletteLoaded = false;
-	static bool hasCustomPalette = false;
+	static MACHINE_STATE uint8 customPalette[64 * 3];
+	static MACHINE_STATE bool customPaletteLoaded = false;
+	static MACHINE_STATE bool hasCustomPalette = false;
 
 	if (customPaletteLoaded == false) {
 		customPaletteLoaded = true;
@@ -10,12 +10,16 @@
 #include "scope_timer/scope_timer.h"
 #include "frontend.h"
 
+#if TARGET_HOST
+#include "host_simd.h"
+#endif
+
 #if TRACE_DEBUG
 static unsigned int ppuWriteBreakpoint = 0x10000;
 extern void PPUBreakpoint();
 #endif
 
-nes_ppu nesPPU ALIGN(256);
+MACHINE_STATE nes_ppu nesPPU ALIGN(256);
 
 static uint16 reverseBytelookup[16] = {
 	0x0, 0x8, 0x4, 0xc, 0x2, 0xa, 0x6, 0xe,
@@ -31,7 +35,7 @@ uint16 reverseByte(uint16 b) {
 // Scanline handling
 
 inline void CopyOver16(uint8* srcBytes) {
-#if TARGET_WINSIM
+#if TARGET_WINSIM || TARGET_HOST
 	memcpy(srcBytes + 16, srcBytes, 16);
 #elif TARGET_PRIZM
 	asm(
@@ -54,7 +58,7 @@ inline void CopyOver16(uint8* srcBytes) {
 }
 
 // scanline buffers with padding to allow fast rendering with clipping
-static unsigned char oamScanlineBuffer[256 + 8] = { 0 }; 
+static MACHINE_STATE unsigned char oamScanlineBuffer[256 + 8] = { 0 }; 
 
 void nes_ppu::copyYScrollRegs() {
 	scrollY = SCROLLY;
@@ -264,7 +268,19 @@ void nes_ppu::writeReg(unsigned int regNum, unsigned char value) {
 			}
 
 			// address will be incremented after the instruction due to latching
-			*resolveMemoryAddress(address, false) = value;
+			unsigned char* target = resolveMemoryAddress(address, false);
+			*target = value;
+
+#if DECODED_TILE_CACHE
+			if (address < 0x2000) {
+				invalidateDecodedTiles(target, 1);
+			}
+#endif
+#if BACKGROUND_LINE_CACHE
+			if (address >= 0x2000 && address < 0x3F00) {
+				nameTableWritten(target);
+			}
+#endif
 
 #if TRACE_DEBUG
 			if (address - ((PPUCTRL & PPUCTRL_VRAMINC) ? 32 : 1) == ppuWriteBreakpoint) {
@@ -306,15 +322,14 @@ void nes_ppu::fastSprite0(bool bValidBackground) {
 
 	if (oam[2] & OAMATTR_VFLIP) yCoord = (spriteSize - 1) - yCoord;
 
-	unsigned char* patternTable = chrPages[((spriteSize == 8 && (PPUCTRL & PPUCTRL_OAMTABLE)) ? 1 : 0)];
-
 	// determine tile index
-	unsigned char* tile;
+	unsigned int tileIndex;
 	if (spriteSize == 16) {
-		tile = chrPages[oam[1] & 1] + ((oam[1] & 0xFE) << 4) + ((yCoord & 8) << 1) + (yCoord & 7);
+		tileIndex = ((oam[1] & 1) << 8) | ((oam[1] & 0xFE) + (yCoord >> 3));
 	} else {
-		tile = patternTable + (oam[1] << 4) + yCoord;
+		tileIndex = ((PPUCTRL & PPUCTRL_OAMTABLE) << 5) | oam[1];
 	}
+	unsigned char* tile = getTile(tileIndex) + (yCoord & 7);
 
 	// interleave the bit planes and assign to char buffer (only unmapped pixels)
 	const uint8 tile0 = tile[0];
@@ -386,18 +401,26 @@ void nes_ppu::fastOAMLatchCheck() {
 }
 
 // clocks per scanline formula: (341 / 3) + (scanline % 3 != 0 ? 1 : 0) for NTSC;
-char scanlineClocks[245];
+MACHINE_STATE char scanlineClocks[245];
 
 void nes_ppu::step() {
 	TIME_SCOPE_NAMED("PPU Step");
 	
 	// calculated once per frame on scanline 1
-	static bool skipFrame = false;
+	static MACHINE_STATE bool skipFrame = false;
 
 	// cpu time for next scanline
 	DebugAssert(scanline < 245);
 	mainCPU.ppuClocks += scanlineClocks[scanline];
     
+	// the sprite overflow flag is only emulated along with the sprite limit
+	if (scanline >= 1 && scanline <= 240 && (PPUMASK & (PPUMASK_SHOWBG | PPUMASK_SHOWOBJ)) && nesSettings.GetSetting(ST_SpriteLimit)) {
+		updateSpriteLines();
+		if (spriteLines.overflow[scanline]) {
+			SetPPUSTATUS(PPUSTATUS | PPUSTAT_OVERFLOW);
+		}
+	}
+
 	/*
 		262 scanlines, we render 9-232 (middle 224 screen lines)
 
@@ -429,7 +452,10 @@ void nes_ppu::step() {
 			skipFrame = (frameCounter & 7) != 0;
 		}
 
-		static bool bWasVolumeUp = false;
+		// with run ahead only the last frame run ahead is drawn
+		skipFrame = nesRunAhead.filterSkipFrame(skipFrame);
+
+		static MACHINE_STATE bool bWasVolumeUp = false;
 		if (nesSettings.CheckCachedKey(NES_VOL_UP)) {
 			if (!bWasVolumeUp) {
 				sndVolumeUp();
@@ -439,7 +465,7 @@ void nes_ppu::step() {
 			bWasVolumeUp = false;
 		}
 
-		static bool bWasVolumeDown = false;
+		static MACHINE_STATE bool bWasVolumeDown = false;
 		if (nesSettings.CheckCachedKey(NES_VOL_DOWN)) {
 			if (!bWasVolumeDown) {
 				sndVolumeDown();
@@ -449,8 +475,8 @@ void nes_ppu::step() {
 			bWasVolumeDown = false;
 		}
 
-		// clear vblank and sprite 0 flag
-		SetPPUSTATUS(PPUSTATUS & ~(PPUSTAT_NMI | PPUSTAT_SPRITE0));		
+		// clear vblank, sprite 0 and sprite overflow flags
+		SetPPUSTATUS(PPUSTATUS & ~(PPUSTAT_NMI | PPUSTAT_SPRITE0 | PPUSTAT_OVERFLOW));
 
 		// time to copy y scroll regs
 		copyYScrollRegs();
@@ -466,7 +492,7 @@ void nes_ppu::step() {
 		// non-resolved but active scanline (may cause sprite 0 collision)
 		if (canSprite0Hit()) {
 			if (!skipFrame) {
-				renderScanline(*this);
+				renderCurrentScanline();
 			} else {
 				fastSprite0(false);
 			}
@@ -487,7 +513,7 @@ void nes_ppu::step() {
 
 		// rendered scanline
 		if (!skipFrame) {
-			renderScanline(*this);
+			renderCurrentScanline();
 
 			if (dirtyPalette) {
 				resolveWorkingPalette();
@@ -509,7 +535,7 @@ void nes_ppu::step() {
 		// non-resolved scanline
 		if (canSprite0Hit()) {
 			if (!skipFrame) {
-				renderScanline(*this);
+				renderCurrentScanline();
 			} else {
 				fastSprite0(false);
 			}
@@ -557,9 +583,9 @@ void nes_ppu::step() {
 		// update the FPS counter
 		if (nesSettings.GetSetting(ST_ShowFPS) && skipFrame == false) {
 			// track fps in 8 half second buckets
-			static int32 frameBuckets[8] = { 0, 0, 0, 0, 0, 0, 0, 0};
-			static int32 curBucket = 0;
-			static int32 lastTicks = 0;
+			static MACHINE_STATE int32 frameBuckets[8] = { 0, 0, 0, 0, 0, 0, 0, 0};
+			static MACHINE_STATE int32 curBucket = 0;
+			static MACHINE_STATE int32 lastTicks = 0;
 			frameBuckets[curBucket]++;
 
 			int32 ticks = RTC_GetTicks();
@@ -578,49 +604,64 @@ void nes_ppu::step() {
 			lastTicks = ticks % 64;
 		}
 
-		finishFrame(skipFrame);
-
-		ScopeTimer::ReportFrame();
+		// when running ahead the frame is finished once the real frame is put back
+		if (!nesRunAhead.frames) {
+			finishFrame(skipFrame);
+		}
 
 		frameCounter++;
 
-		bool keyDown_fast(unsigned char keyCode);
-		if (keyDown_fast(48)) // Menu
-		{
-			extern bool shouldExit;
-			shouldExit = true;
-			while (keyDown_fast(48)) {}
-		}
+		// the rest happens once per real frame, frames run ahead keep the input already read
+		if (!nesRunAhead.bRunning) {
+			ScopeTimer::ReportFrame();
+
+			bool keyDown_fast(unsigned char keyCode);
+			if (keyDown_fast(48)) // Menu
+			{
+				extern MACHINE_STATE bool shouldExit;
+				shouldExit = true;
+				while (keyDown_fast(48)) {}
+			}
 
 #if DEBUG
-		if (keyDown_fast(69)) // F2
-		{
-			ScopeTimer::DisplayTimes();
-		}
+			if (keyDown_fast(69)) // F2
+			{
+				ScopeTimer::DisplayTimes();
+			}
 #endif
 
-		if (keyDown_fast(10)) // AC/ON
-		{
-			nesFrontend.ResetPressed();
-		}
+#if !TARGET_HOST
+			if (keyDown_fast(10)) // AC/ON
+			{
+				nesFrontend.ResetPressed();
+			}
+#endif
 
-		input_cacheKeys();
+			input_cacheKeys();
 
-		if (nesSettings.CheckCachedKey(NES_SAVESTATE)) // F3 in simulator, 'S" on device
-		{
-			nesCart.SaveState();
-			nesCart.BuildFileBlocks();
-		}
+			if (nesSettings.CheckCachedKey(NES_SAVESTATE)) // F3 in simulator, 'S" on device
+			{
+				nesCart.SaveState();
+				nesCart.BuildFileBlocks();
+			}
 
-		if (nesSettings.CheckCachedKey(NES_LOADSTATE)) // F4 in simulator, 'L' on device
-		{
-			nesCart.LoadState();
-		}
+			if (nesSettings.CheckCachedKey(NES_LOADSTATE)) // F4 in simulator, 'L' on device
+			{
+				nesCart.LoadState();
+			}
 
-		// good time to synchronize cpu clock if we are getting too high (to avoid wraparound at 30 min of play)
-		mainCPU.syncClocks();
+			nesMovie.step();
+
+			// rewind points are captured here, so going back to one resumes from this point in the frame
+			nesRewind.step();
+
+			nesCart.AutoSaveWRAM();
+		}
 
 	} else if (scanline == 243) {
+		// nothing renders until scanline 262, so copy in the banks the game is likely to map next
+		nesCart.PrefetchBanks();
+
 		// frame is over, don't run until scanline 262, so add 18 scanlines worth (2047 extra clocks!)
 		if (nesCart.isPAL == 0) {
 			mainCPU.ppuClocks += 18 * (341 / 3) + 12;
@@ -645,7 +686,17 @@ void nes_ppu::step() {
 
 	scanline++;
 
+	// frames run ahead are never heard
+	if (nesRunAhead.bRunning) {
+		return;
+	}
+
 	condSoundUpdate();
+
+	// the real frame is over, so run ahead from the input it read
+	if (scanline == 243 && nesRunAhead.frames) {
+		nesRunAhead.run();
+	}
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -726,13 +777,139 @@ uint8 OverlayTable[8 * 256] = {
 	2,2,2,2,2,0,0,0,2,2,2,2,2,0,0,2,2,2,2,2,2,0,2,0,2,2,2,2,2,0,2,2,2,2,2,2,2,2,0,0,2,2,2,2,2,2,0,2,2,2,2,2,2,2,2,0,2,2,2,2,2,2,2,2,
 };
 
-#if TARGET_WINSIM
+#if DECODED_TILE_CACHE
+#define NUM_DECODED_TABLES 16
+
+// tile rows of one 1 KB character page decoded to 8 palette index bytes, ready to OR with the unrolled palette
+struct nes_decoded_tiles {
+	uint32 rows[64 * 8][2];
+	uint8 valid[64];
+	const unsigned char* source;		// character memory the rows are decoded from, NULL if unused
+	uint32 lastUsed;					// decodedTileClock when last looked up
+
+	const uint32* getRow(unsigned int tile, unsigned int row) {
+		if (!valid[tile]) {
+			const unsigned char* pattern = source + (tile << 4);
+#if TARGET_HOST
+			Host_DecodeTile(pattern, (uint8*) rows[tile * 8]);
+#else
+			for (int r = 0; r < 8; r++) {
+				const uint32* bitPlane1 = (const uint32*) &OverlayTable[pattern[r] * 8];
+				const uint32* bitPlane2 = (const uint32*) &OverlayTable[pattern[r + 8] * 8];
+				rows[tile * 8 + r][0] = bitPlane1[0] | (bitPlane2[0] << 1);
+				rows[tile * 8 + r][1] = bitPlane1[1] | (bitPlane2[1] << 1);
+			}
+#endif
+			valid[tile] = 1;
+		}
+		return rows[tile * 8 + row];
+	}
+};
+
+static MACHINE_STATE nes_decoded_tiles decodedTiles[NUM_DECODED_TABLES];
+static MACHINE_STATE uint32 decodedTileClock = 0;
+
+// returns the decoded tiles for the given character page, reusing the least recently used table on a miss. The tables
+// just returned for the other pages of a pattern table are the most recently used, so they are never the one reused
+static nes_decoded_tiles* getDecodedTiles(const unsigned char* page) {
+	// the clock is moved back by half before it wraps, which keeps the order of the recently used tables
+	if (++decodedTileClock == 0) {
+		for (int i = 0; i < NUM_DECODED_TABLES; i++) {
+			decodedTiles[i].lastUsed = decodedTiles[i].lastUsed > 0x80000000u ? decodedTiles[i].lastUsed - 0x80000000u : 0;
+		}
+		decodedTileClock = 0x80000000u;
+	}
+
+	for (int i = 0; i < NUM_DECODED_TABLES; i++) {
+		if (decodedTiles[i].source == page) {
+			decodedTiles[i].lastUsed = decodedTileClock;
+			return &decodedTiles[i];
+		}
+	}
+
+	nes_decoded_tiles* tiles = &decodedTiles[0];
+	for (int i = 1; i < NUM_DECODED_TABLES; i++) {
+		if (decodedTiles[i].lastUsed < tiles->lastUsed) {
+			tiles = &decodedTiles[i];
+		}
+	}
+
+	memset(tiles->valid, 0, sizeof(tiles->valid));
+	tiles->source = page;
+	tiles->lastUsed = decodedTileClock;
+	return tiles;
+}
+
+void nes_ppu::invalidateDecodedTiles() {
+	for (int i = 0; i < NUM_DECODED_TABLES; i++) {
+		decodedTiles[i].source = NULL;
+	}
+
+#if BACKGROUND_LINE_CACHE
+	invalidateBackgroundLines();
+#endif
+}
+
+void nes_ppu::invalidateDecodedTiles(const unsigned char* ptr, unsigned int size) {
+#if BACKGROUND_LINE_CACHE
+	chrWritten(ptr, size);
+#endif
+
+	for (int i = 0; i < NUM_DECODED_TABLES; i++) {
+		nes_decoded_tiles& tiles = decodedTiles[i];
+		if (tiles.source && ptr < tiles.source + 0x400 && ptr + size > tiles.source) {
+			int first = ptr > tiles.source ? (ptr - tiles.source) >> 4 : 0;
+			int last = ptr + size < tiles.source + 0x400 ? (ptr + size - 1 - tiles.source) >> 4 : 63;
+			memset(&tiles.valid[first], 0, last - first + 1);
+		}
+	}
+}
+
+// returns the decoded row of the given tile (0 - 511)
+static FORCE_INLINE const uint32* getDecodedRow(nes_ppu& ppu, unsigned int tile, unsigned int row) {
+	return getDecodedTiles(ppu.chrPages[tile >> 6])->getRow(tile & 63, row);
+}
+
+// decoded pages of a 4 KB pattern table and tile row to render a background scanline from
+struct nes_pattern_table {
+	nes_decoded_tiles* tiles[4];
+	unsigned int row;
+};
+
+static FORCE_INLINE nes_pattern_table getPatternTable(unsigned char* const* pages, unsigned int row) {
+	nes_pattern_table result = { { getDecodedTiles(pages[0]), getDecodedTiles(pages[1]), getDecodedTiles(pages[2]), getDecodedTiles(pages[3]) }, row };
+	return result;
+}
+
+// a table lookup and palette OR per tile
+inline void RenderToScanline(const nes_pattern_table& patternTable, int chr, uint32 unrolledPalette, uint8* buffer) {
+	DebugAssert(uintptr_t(buffer) % 4 == 0);
+
+	const uint32* row = patternTable.tiles[chr >> 10]->getRow((chr >> 4) & 63, patternTable.row);
+	unsigned int* scanline = (unsigned int*) buffer;
+	scanline[0] = unrolledPalette | row[0];
+	scanline[1] = unrolledPalette | row[1];
+}
+#else
+// character pages of a 4 KB pattern table and tile row to render a background scanline from
+struct nes_pattern_table {
+	unsigned char* const* pages;
+	unsigned int row;
+};
+
+static FORCE_INLINE nes_pattern_table getPatternTable(unsigned char* const* pages, unsigned int row) {
+	nes_pattern_table result = { pages, row };
+	return result;
+}
+
+#if TARGET_WINSIM || TARGET_HOST
 // super fast blitting method!
-inline void RenderToScanline(unsigned char*patternTable, int chr, uint32 unrolledPalette, uint8* buffer) {
+inline void RenderToScanline(nes_pattern_table patternTable, int chr, uint32 unrolledPalette, uint8* buffer) {
 	DebugAssert(uint32(buffer) % 4 == 0); // long alignment required in SH4
 
-	unsigned int* bitPlane1 = (unsigned int*) &OverlayTable[patternTable[chr] * 8];
-	unsigned int* bitPlane2 = (unsigned int*) &OverlayTable[patternTable[chr + 8] * 8];
+	const unsigned char* pattern = patternTable.pages[chr >> 10] + (chr & 0x3FF) + patternTable.row;
+	unsigned int* bitPlane1 = (unsigned int*) &OverlayTable[pattern[0] * 8];
+	unsigned int* bitPlane2 = (unsigned int*) &OverlayTable[pattern[8] * 8];
 	unsigned int* scanline = (unsigned int*) buffer;
 	scanline[0] = unrolledPalette | bitPlane1[0] | (bitPlane2[0] << 1);
 	scanline[1] = unrolledPalette | bitPlane1[1] | (bitPlane2[1] << 1);
@@ -741,37 +918,70 @@ inline void RenderToScanline(unsigned char*patternTable, int chr, uint32 unrolle
 extern "C" {
 	void RenderToScanline(unsigned char*patternTable, int chr, uint32 unrolledPalette, uint8* buffer);
 }
+
+// picks the 1 KB page for the asm blitter
+static FORCE_INLINE void RenderToScanline(nes_pattern_table patternTable, int chr, uint32 unrolledPalette, uint8* buffer) {
+	RenderToScanline(patternTable.pages[chr >> 10] + patternTable.row, chr & 0x3FF, unrolledPalette, buffer);
+}
+#endif
 #endif
 
-// mask of which sprites to check per scanline (bit 0 = sprites 56-63, bit 1 = sprites 48-55, and so on)
-uint8 fetchMask[272];
 template<int spriteSize>
-void nes_ppu::resolveOAM() {
-	// rebuild the fetch mask
-	memset(fetchMask, 0, 240);
-
-	unsigned char* curObj = &oam[252];
+void nes_ppu::resolveOAM(bool bLimited) {
+	// sprites are drawn the scanline after their Y coordinate
 	const int scanlineOffset = 2;
+	const unsigned int limit = bLimited ? 8 : 64;
+
+	memset(spriteLines.count, 0, sizeof(spriteLines.count));
+	memset(spriteLines.overflow, 0, sizeof(spriteLines.overflow));
+
+	// count sprites per line, keeping the first 8 in OAM order when limited like the hardware
+	for (int i = 0; i < 256; i += 4) {
+		unsigned int line = oam[i] + scanlineOffset;
+		for (int y = 0; y < spriteSize && line <= 240; y++, line++) {
+			if (spriteLines.count[line] == 8) spriteLines.overflow[line] = true;
+			if (spriteLines.count[line] < limit) spriteLines.count[line]++;
+		}
+	}
 
-	for (int b = 0; b < 8; b++) {
-		uint8 bitMask = (1 << b);
-		for (int i = 0; i < 8; i++, curObj -= 4) {
-			unsigned int line = curObj[0] + scanlineOffset;
-			for (int x = 0; x < spriteSize; x++, line++) {
-				fetchMask[line] |= bitMask;
+	spriteLines.start[0] = 0;
+	for (int line = 0; line <= 240; line++) {
+		spriteLines.start[line + 1] = spriteLines.start[line] + spriteLines.count[line];
+	}
+
+	// fill each line's list in OAM order
+	uint8 filled[241] = { 0 };
+	for (int i = 0; i < 256; i += 4) {
+		unsigned int line = oam[i] + scanlineOffset;
+		for (int y = 0; y < spriteSize && line <= 240; y++, line++) {
+			if (filled[line] < spriteLines.count[line]) {
+				spriteLines.list[spriteLines.start[line] + filled[line]++] = i;
 			}
 		}
 	}
 
+	spriteLines.spriteSize = spriteSize;
+	spriteLines.bLimited = bLimited;
 	dirtyOAM = false;
 }
 
+void nes_ppu::updateSpriteLines() {
+	const bool bLimited = nesSettings.GetSetting(ST_SpriteLimit) != 0;
+	if ((PPUCTRL & PPUCTRL_SPRSIZE) == 0) {
+		if (dirtyOAM || spriteLines.spriteSize != 8 || spriteLines.bLimited != bLimited) {
+			resolveOAM<8>(bLimited);
+		}
+	} else {
+		if (dirtyOAM || spriteLines.spriteSize != 16 || spriteLines.bLimited != bLimited) {
+			resolveOAM<16>(bLimited);
+		}
+	}
+}
+
 #define PRIORITY_PIXEL 0x40
 template<bool sprite16,int spriteSize>
 void static renderOAM(nes_ppu& ppu) {
-	if (ppu.dirtyOAM) {
-		ppu.resolveOAM<spriteSize>();
-	}
+	ppu.updateSpriteLines();
 
 	// MMC2/4 support
 	if (nesCart.renderLatch) {
@@ -786,81 +996,96 @@ void static renderOAM(nes_ppu& ppu) {
 		}
 	}
 
-	if ((ppu.PPUMASK & PPUMASK_SHOWOBJ) && fetchMask[ppu.scanline]) {
+	if ((ppu.PPUMASK & PPUMASK_SHOWOBJ) && ppu.spriteLines.count[ppu.scanline]) {
 		// render objects to separate buffer
 		int numSprites = 0;
-		unsigned char* curObj = &ppu.oam[252];
-		unsigned int patternOffset = ((!sprite16 && (ppu.PPUCTRL & PPUCTRL_OAMTABLE)) ? 1 : 0);
-		unsigned char* patternTable = ppu.chrPages[patternOffset];
-		static uint8 spriteMask[33] = { 0 };
+		unsigned int patternOffset = ((!sprite16 && (ppu.PPUCTRL & PPUCTRL_OAMTABLE)) ? 0x100 : 0);
+		static MACHINE_STATE uint8 spriteMask[33] = { 0 };
 		int minSpriteMask = 32;
 		int maxSpriteMask = 0;
 		int scanlineOffset = ppu.scanline - 2;
 
-		// mask out 8 at a time
-		for (int b = fetchMask[ppu.scanline]; b; b = b >> 1) {
-			if (!(b & 1)) {
-				curObj -= 32;
-				continue;
-			}
+		// lower OAM indices are drawn last so they end up on top
+		const uint8* lineSprites = ppu.spriteLines.getSprites(ppu.scanline);
+		for (int s = ppu.spriteLines.count[ppu.scanline] - 1; s >= 0; s--) {
+			unsigned char* curObj = &ppu.oam[lineSprites[s]];
+			unsigned int yCoord = scanlineOffset - curObj[0];
+			numSprites++;
 
-			for (int i = 0; i < 8; i++, curObj -= 4) {
-				unsigned int yCoord = scanlineOffset - curObj[0];
-				if (yCoord < spriteSize) {
-					numSprites++;
+			if (curObj[2] & OAMATTR_VFLIP) yCoord = (spriteSize - 1) - yCoord;
 
-					if (curObj[2] & OAMATTR_VFLIP) yCoord = (spriteSize - 1) - yCoord;
+			unsigned int x = curObj[3];
+			unsigned int palette = (((curObj[2] & 3) << 2) + (curObj[2] & OAMATTR_PRIORITY) + 16) << 1;
+			unsigned char* buffer = oamScanlineBuffer + x;
 
-					// determine tile index
-					unsigned char* tile;
-					if (sprite16) {
-						tile = ppu.chrPages[curObj[1] & 1] + ((curObj[1] & 0xFE) << 4) + ((yCoord & 8) << 1) + (yCoord & 7);
-					} else {
-						tile = patternTable + (curObj[1] << 4) + yCoord;
-					}
+			// determine tile index
+			unsigned int tileIndex;
+			if (sprite16) {
+				tileIndex = ((curObj[1] & 1) << 8) | ((curObj[1] & 0xFE) + (yCoord >> 3));
+			} else {
+				tileIndex = patternOffset | curObj[1];
+			}
 
-					unsigned int x = curObj[3];
-
-					// interleave the bit planes and assign to char buffer (only unmapped pixels)
-					const uint8 tile0 = tile[0];
-					const uint8 tile8 = tile[8];
-					uint16 tileMask = (tile0 | tile8);
-					unsigned int bitPlane = (MortonTable[tile0] | (MortonTable[tile8] << 1)) << 1;
-					unsigned int palette = (((curObj[2] & 3) << 2) + (curObj[2] & OAMATTR_PRIORITY) + 16) << 1;
-					unsigned char* buffer = oamScanlineBuffer + x;
-
-					if (curObj[2] & OAMATTR_HFLIP) {
-											if (bitPlane & 6) buffer[0] = palette | (bitPlane & 6);
-						bitPlane >>= 2;		if (bitPlane & 6) buffer[1] = palette | (bitPlane & 6);
-						bitPlane >>= 2;		if (bitPlane & 6) buffer[2] = palette | (bitPlane & 6);
-						bitPlane >>= 2;		if (bitPlane & 6) buffer[3] = palette | (bitPlane & 6);
-						bitPlane >>= 2;		if (bitPlane & 6) buffer[4] = palette | (bitPlane & 6);
-						bitPlane >>= 2;		if (bitPlane & 6) buffer[5] = palette | (bitPlane & 6);
-						bitPlane >>= 2;		if (bitPlane & 6) buffer[6] = palette | (bitPlane & 6);
-						bitPlane >>= 2;		if (bitPlane & 6) buffer[7] = palette | (bitPlane & 6);
-					} else {
-						tileMask = reverseByte(tileMask);
-											if (bitPlane & 6) buffer[7] = palette | (bitPlane & 6);
-						bitPlane >>= 2;		if (bitPlane & 6) buffer[6] = palette | (bitPlane & 6);
-						bitPlane >>= 2;		if (bitPlane & 6) buffer[5] = palette | (bitPlane & 6);
-						bitPlane >>= 2;		if (bitPlane & 6) buffer[4] = palette | (bitPlane & 6);
-						bitPlane >>= 2;		if (bitPlane & 6) buffer[3] = palette | (bitPlane & 6);
-						bitPlane >>= 2;		if (bitPlane & 6) buffer[2] = palette | (bitPlane & 6); 
-						bitPlane >>= 2;		if (bitPlane & 6) buffer[1] = palette | (bitPlane & 6);
-						bitPlane >>= 2;		if (bitPlane & 6) buffer[0] = palette | (bitPlane & 6);
-					}
+#if DECODED_TILE_CACHE
+			// decoded row is in pixel order, assign to char buffer (only unmapped pixels)
+			const uint8* row = (const uint8*) getDecodedRow(ppu, tileIndex, yCoord & 7);
 
-					int mask = x >> 3;
-					tileMask = tileMask << (x & 7);
-					spriteMask[mask] |= tileMask & 0xFF;
-					if (mask < minSpriteMask) minSpriteMask = mask;
-					if (mask > maxSpriteMask) maxSpriteMask = mask;
-					mask = (x+7) >> 3;
-					spriteMask[mask] |= tileMask >> 8;
-					if (mask < minSpriteMask) minSpriteMask = mask;
-					if (mask > maxSpriteMask) maxSpriteMask = mask;
+			uint16 tileMask = 0;
+			if (curObj[2] & OAMATTR_HFLIP) {
+				for (int p = 0; p < 8; p++) {
+					if (row[7 - p]) {
+						buffer[p] = palette | row[7 - p];
+						tileMask |= 1 << p;
+					}
 				}
+			} else {
+				for (int p = 0; p < 8; p++) {
+					if (row[p]) {
+						buffer[p] = palette | row[p];
+						tileMask |= 1 << p;
+					}
+				}
+			}
+#else
+			unsigned char* tile = ppu.getTile(tileIndex) + (yCoord & 7);
+
+			// interleave the bit planes and assign to char buffer (only unmapped pixels)
+			const uint8 tile0 = tile[0];
+			const uint8 tile8 = tile[8];
+			uint16 tileMask = (tile0 | tile8);
+			unsigned int bitPlane = (MortonTable[tile0] | (MortonTable[tile8] << 1)) << 1;
+
+			if (curObj[2] & OAMATTR_HFLIP) {
+									if (bitPlane & 6) buffer[0] = palette | (bitPlane & 6);
+				bitPlane >>= 2;		if (bitPlane & 6) buffer[1] = palette | (bitPlane & 6);
+				bitPlane >>= 2;		if (bitPlane & 6) buffer[2] = palette | (bitPlane & 6);
+				bitPlane >>= 2;		if (bitPlane & 6) buffer[3] = palette | (bitPlane & 6);
+				bitPlane >>= 2;		if (bitPlane & 6) buffer[4] = palette | (bitPlane & 6);
+				bitPlane >>= 2;		if (bitPlane & 6) buffer[5] = palette | (bitPlane & 6);
+				bitPlane >>= 2;		if (bitPlane & 6) buffer[6] = palette | (bitPlane & 6);
+				bitPlane >>= 2;		if (bitPlane & 6) buffer[7] = palette | (bitPlane & 6);
+			} else {
+				tileMask = reverseByte(tileMask);
+									if (bitPlane & 6) buffer[7] = palette | (bitPlane & 6);
+				bitPlane >>= 2;		if (bitPlane & 6) buffer[6] = palette | (bitPlane & 6);
+				bitPlane >>= 2;		if (bitPlane & 6) buffer[5] = palette | (bitPlane & 6);
+				bitPlane >>= 2;		if (bitPlane & 6) buffer[4] = palette | (bitPlane & 6);
+				bitPlane >>= 2;		if (bitPlane & 6) buffer[3] = palette | (bitPlane & 6);
+				bitPlane >>= 2;		if (bitPlane & 6) buffer[2] = palette | (bitPlane & 6); 
+				bitPlane >>= 2;		if (bitPlane & 6) buffer[1] = palette | (bitPlane & 6);
+				bitPlane >>= 2;		if (bitPlane & 6) buffer[0] = palette | (bitPlane & 6);
 			}
+#endif
+
+			int mask = x >> 3;
+			tileMask = tileMask << (x & 7);
+			spriteMask[mask] |= tileMask & 0xFF;
+			if (mask < minSpriteMask) minSpriteMask = mask;
+			if (mask > maxSpriteMask) maxSpriteMask = mask;
+			mask = (x+7) >> 3;
+			spriteMask[mask] |= tileMask >> 8;
+			if (mask < minSpriteMask) minSpriteMask = mask;
+			if (mask > maxSpriteMask) maxSpriteMask = mask;
 		}
 
 		if (numSprites) {
@@ -907,12 +1132,123 @@ void nes_ppu::doOAMRender() {
 	}
 }
 
-void nes_ppu::resolveOAMExternal() {
-	if ((PPUCTRL & PPUCTRL_SPRSIZE) == 0) {
-		resolveOAM<8>();
+#if BACKGROUND_LINE_CACHE
+#define BACKGROUND_LINE_SIZE (16 * 18)
+
+// background of one scanline and the inputs it was rendered from
+struct nes_background_line {
+	uint32 stamp;					// backgroundStamp when rendered
+	const unsigned char* chrPages[4];
+	nes_nametable* nameTables;
+	int mirror;
+	int scrollY;
+	bool flipY;
+	uint8 scrollX;
+	uint8 ctrl;
+	uint8 pixels[BACKGROUND_LINE_SIZE];
+};
+
+static MACHINE_STATE nes_background_line backgroundLines[241];
+
+// every change to background inputs takes the next stamp, so a line is current while no stamp it depends on is newer
+static MACHINE_STATE uint32 backgroundStamp = 1;
+static MACHINE_STATE uint32 chrStamp = 1;
+static MACHINE_STATE uint32 nameTableRowStamp[4][30] = { 0 };
+
+// CHR pages are told apart by where they start, pages that share an entry just invalidate each other's lines
+#define CHR_PAGE_STAMPS 64
+static MACHINE_STATE uint32 chrPageStamp[CHR_PAGE_STAMPS] = { 0 };
+
+static FORCE_INLINE uint32& getChrPageStamp(const unsigned char* page) {
+	return chrPageStamp[(uintptr_t(page) >> 10) & (CHR_PAGE_STAMPS - 1)];
+}
+
+void nes_ppu::nameTableWritten(const unsigned char* ptr) {
+	unsigned int offset = ptr - nameTables[0].table;
+	if (offset >= 4 * sizeof(nes_nametable)) {
+		return;
+	}
+
+	uint32* rowStamp = nameTableRowStamp[offset >> 10];
+	offset &= 0x3FF;
+	if (offset < 960) {
+		rowStamp[offset >> 5] = ++backgroundStamp;
 	} else {
-		resolveOAM<16>();
+		// each attribute byte covers 4 tile rows
+		unsigned int row = ((offset - 960) >> 3) << 2;
+		backgroundStamp++;
+		for (unsigned int r = row; r < row + 4 && r < 30; r++) {
+			rowStamp[r] = backgroundStamp;
+		}
+	}
+}
+
+void nes_ppu::invalidateBackgroundLines() {
+	chrStamp = ++backgroundStamp;
+}
+
+void nes_ppu::chrWritten(const unsigned char* ptr, unsigned int size) {
+	backgroundStamp++;
+
+	// single bytes are written through the pages mapped now, whole pages and banks are given by where they start
+	for (int i = 0; i < 8; i++) {
+		if (ptr < chrPages[i] + 0x400 && ptr + size > chrPages[i]) {
+			getChrPageStamp(chrPages[i]) = backgroundStamp;
+		}
+	}
+	for (unsigned int offset = 0; offset + 0x400 <= size; offset += 0x400) {
+		getChrPageStamp(ptr + offset) = backgroundStamp;
+	}
+}
+#endif
+
+void nes_ppu::renderCurrentScanline() {
+#if BACKGROUND_LINE_CACHE
+	// MMC2/4 latches and the blank background paths have side effects, so they always render
+	nes_background_line* cached = NULL;
+	int line = scanline - 1 + (scrollY < 240 ? scrollY : scrollY - 256);
+	if ((PPUMASK & PPUMASK_SHOWBG) && line >= 0 && !nesCart.renderLatch) {
+		cached = &backgroundLines[scanline];
+
+		unsigned char* const* chrPage = &chrPages[(PPUCTRL & PPUCTRL_BGDTABLE) >> 2];
+		const uint8 ctrl = PPUCTRL & (PPUCTRL_BGDTABLE | PPUCTRL_FLIPXTBL | PPUCTRL_FLIPYTBL);
+
+		// the tile row is the same in every mirroring mode, only which name table differs
+		const int row = (line >> 3) % 30;
+		uint32 lastChange = chrStamp;
+		for (int i = 0; i < 4; i++) {
+			if (nameTableRowStamp[i][row] > lastChange) lastChange = nameTableRowStamp[i][row];
+			if (getChrPageStamp(chrPage[i]) > lastChange) lastChange = getChrPageStamp(chrPage[i]);
+		}
+
+		if (cached->stamp >= lastChange && !memcmp(cached->chrPages, chrPage, sizeof(cached->chrPages)) && cached->nameTables == nameTables &&
+			cached->mirror == mirror && cached->scrollX == SCROLLX && cached->scrollY == scrollY &&
+			cached->flipY == flipY && cached->ctrl == ctrl) {
+			memcpy(scanlineBuffer, cached->pixels, BACKGROUND_LINE_SIZE);
+			doOAMRender();
+			return;
+		}
+
+		cached->stamp = backgroundStamp;
+		memcpy(cached->chrPages, chrPage, sizeof(cached->chrPages));
+		cached->nameTables = nameTables;
+		cached->mirror = mirror;
+		cached->scrollX = SCROLLX;
+		cached->scrollY = scrollY;
+		cached->flipY = flipY;
+		cached->ctrl = ctrl;
+	}
+#endif
+
+	renderScanline(*this);
+
+#if BACKGROUND_LINE_CACHE
+	if (cached) {
+		memcpy(cached->pixels, scanlineBuffer, BACKGROUND_LINE_SIZE);
 	}
+#endif
+
+	doOAMRender();
 }
 
 inline void UnrollPalette(uint32& palette) {
@@ -943,7 +1279,7 @@ void nes_ppu::renderScanline_SingleMirror(nes_ppu& ppu) {
 		unsigned char* nameTable;
 		unsigned char* attr;
 		unsigned int chrOffset = (line & 7);
-		unsigned char* patternTable = ppu.chrPages[(ppu.PPUCTRL & PPUCTRL_BGDTABLE) >> 4] + chrOffset;
+		nes_pattern_table patternTable = getPatternTable(&ppu.chrPages[(ppu.PPUCTRL & PPUCTRL_BGDTABLE) >> 2], chrOffset);
 
 		if (tileLine >= 30) {
 			tileLine -= 30;
@@ -1013,8 +1349,6 @@ void nes_ppu::renderScanline_SingleMirror(nes_ppu& ppu) {
 			ppu.scrollY--;
 		}
 	}
-
-	ppu.doOAMRender();
 }
 
 void nes_ppu::renderScanline_HorzMirror(nes_ppu& ppu) {
@@ -1037,7 +1371,7 @@ void nes_ppu::renderScanline_HorzMirror(nes_ppu& ppu) {
 		unsigned char* nameTable;
 		unsigned char* attr;
 		unsigned int chrOffset = (line & 7);
-		unsigned char* patternTable = ppu.chrPages[(ppu.PPUCTRL & PPUCTRL_BGDTABLE) >> 4] + chrOffset;
+		nes_pattern_table patternTable = getPatternTable(&ppu.chrPages[(ppu.PPUCTRL & PPUCTRL_BGDTABLE) >> 2], chrOffset);
 
 		if (ppu.flipY) {
 			tileLine += 30;
@@ -1099,13 +1433,13 @@ void nes_ppu::renderScanline_HorzMirror(nes_ppu& ppu) {
 					RenderToScanline(patternTable, chr1 << 4, palette, buffer);
 					if (chr1 >= 0xFD && nesCart.renderLatch) {
 						nesCart.renderLatch((chr1 << 4) + chrOffset + 8 + ((ppu.PPUCTRL & PPUCTRL_BGDTABLE) << 8));
-						patternTable = ppu.chrPages[(ppu.PPUCTRL & PPUCTRL_BGDTABLE) >> 4] + chrOffset;
+						patternTable = getPatternTable(&ppu.chrPages[(ppu.PPUCTRL & PPUCTRL_BGDTABLE) >> 2], chrOffset);
 					}
 					buffer += 8;
 					RenderToScanline(patternTable, chr2 << 4, palette, buffer);
 					if (chr2 >= 0xFD && nesCart.renderLatch) {
 						nesCart.renderLatch((chr2 << 4) + chrOffset + 8 + ((ppu.PPUCTRL & PPUCTRL_BGDTABLE) << 8));
-						patternTable = ppu.chrPages[(ppu.PPUCTRL & PPUCTRL_BGDTABLE) >> 4] + chrOffset;
+						patternTable = getPatternTable(&ppu.chrPages[(ppu.PPUCTRL & PPUCTRL_BGDTABLE) >> 2], chrOffset);
 					}
 					buffer += 8;
 				}
@@ -1147,8 +1481,6 @@ void nes_ppu::renderScanline_HorzMirror(nes_ppu& ppu) {
 			ppu.scrollY--;
 		}
 	}
-
-	ppu.doOAMRender();
 }
 
 template<bool hasLatch, bool is4Pane>
@@ -1196,7 +1528,7 @@ static void renderScanline_VertMirror_Latched(nes_ppu& ppu) {
 		unsigned char* attr;
 		int attrShift = (tileLine & 2) << 1;	// 4 bit shift for bottom row of attribute
 		unsigned int chrOffset = (line & 7);
-		unsigned char* patternTable = ppu.chrPages[(ppu.PPUCTRL & PPUCTRL_BGDTABLE) >> 4] + chrOffset;
+		nes_pattern_table patternTable = getPatternTable(&ppu.chrPages[(ppu.PPUCTRL & PPUCTRL_BGDTABLE) >> 2], chrOffset);
 
 		if (ppu.PPUCTRL & PPUCTRL_FLIPXTBL) scrollX += 256;
 
@@ -1238,7 +1570,7 @@ static void renderScanline_VertMirror_Latched(nes_ppu& ppu) {
 					buffer += 8;
 
 					if (hadLatch) {
-						patternTable = ppu.chrPages[(ppu.PPUCTRL & PPUCTRL_BGDTABLE) >> 4] + chrOffset;
+						patternTable = getPatternTable(&ppu.chrPages[(ppu.PPUCTRL & PPUCTRL_BGDTABLE) >> 2], chrOffset);
 						hadLatch = false;
 					}
 
@@ -1251,7 +1583,7 @@ static void renderScanline_VertMirror_Latched(nes_ppu& ppu) {
 					buffer += 8;
 
 					if (hadLatch) {
-						patternTable = ppu.chrPages[(ppu.PPUCTRL & PPUCTRL_BGDTABLE) >> 4] + chrOffset;
+						patternTable = getPatternTable(&ppu.chrPages[(ppu.PPUCTRL & PPUCTRL_BGDTABLE) >> 2], chrOffset);
 						hadLatch = false;
 					}
 				} else {
@@ -1297,7 +1629,7 @@ static void renderScanline_VertMirror_Latched(nes_ppu& ppu) {
 					buffer += 8;
 
 					if (hadLatch) {
-						patternTable = ppu.chrPages[(ppu.PPUCTRL & PPUCTRL_BGDTABLE) >> 4] + chrOffset;
+						patternTable = getPatternTable(&ppu.chrPages[(ppu.PPUCTRL & PPUCTRL_BGDTABLE) >> 2], chrOffset);
 						hadLatch = false;
 					}
 
@@ -1310,7 +1642,7 @@ static void renderScanline_VertMirror_Latched(nes_ppu& ppu) {
 					buffer += 8;
 
 					if (hadLatch) {
-						patternTable = ppu.chrPages[(ppu.PPUCTRL & PPUCTRL_BGDTABLE) >> 4] + chrOffset;
+						patternTable = getPatternTable(&ppu.chrPages[(ppu.PPUCTRL & PPUCTRL_BGDTABLE) >> 2], chrOffset);
 						hadLatch = false;
 					}
 				} else {
@@ -1340,8 +1672,6 @@ static void renderScanline_VertMirror_Latched(nes_ppu& ppu) {
 			ppu.scrollY--;
 		}
 	}
-	 
-	ppu.doOAMRender();
 }
 
 void nes_ppu::renderScanline_VertMirror(nes_ppu& ppu) {
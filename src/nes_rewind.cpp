@@ -0,0 +1,229 @@
+
+// Rewind history (see nes_rewind in nes.h)
+
+#include "platform.h"
+#include "debug.h"
+#include "nes.h"
+#include "settings.h"
+#include "scope_timer/scope_timer.h"
+
+MACHINE_STATE nes_rewind nesRewind;
+
+void nes_rewind::reset() {
+	ring = NULL;
+	bHasLatest = false;
+	bAtLatest = false;
+	bEncoding = false;
+	framesUntilCapture = REWIND_INTERVAL;
+	head = tail = wrapEnd = 0;
+	numEntries = 0;
+
+	if (REWIND_BUFFER_SIZE == 0) {
+		return;
+	}
+
+	if (!memory) {
+		memory = (uint8*) malloc(REWIND_BUFFER_SIZE);
+		if (!memory) {
+			printf("No memory for rewind");
+			return;
+		}
+	}
+
+	// the encoded delta can be a few words larger than the snapshot when nothing matches
+	snapshotSize = Snapshot::GetSize();
+	const uint32 encodedSize = snapshotSize + 64;
+	if (snapshotSize * 3 + encodedSize > REWIND_BUFFER_SIZE) {
+		printf("Rewind needs %d KB", (snapshotSize * 3 + encodedSize) / 1024);
+		return;
+	}
+
+	latest = memory;
+	pending = memory + snapshotSize;
+	encoded = (uint32*) (memory + snapshotSize * 2);
+	ring = (uint32*) (memory + snapshotSize * 2 + encodedSize);
+	ringWords = (REWIND_BUFFER_SIZE - snapshotSize * 2 - encodedSize) / 4;
+}
+
+void nes_rewind::step() {
+	if (!ring) {
+		return;
+	}
+
+	TIME_SCOPE();
+
+	if (nesSettings.CheckCachedKey(NES_REWIND)) {
+		stepBack();
+		return;
+	}
+
+	bAtLatest = false;
+
+	const uint32 snapshotWords = snapshotSize / 4;
+	if (bEncoding) {
+		uint32 endPos = encodePos + REWIND_ENCODE_BUDGET / 4;
+		encode(endPos < snapshotWords ? endPos : snapshotWords);
+
+		if (encodePos == snapshotWords) {
+			encoded[runHeader] = zeroWords | (literalWords << 16);
+			pushEntry();
+
+			uint8* swap = latest;
+			latest = pending;
+			pending = swap;
+			bEncoding = false;
+		}
+	}
+
+	// the next point waits for the last one to finish encoding
+	if (--framesUntilCapture <= 0 && !bEncoding) {
+		framesUntilCapture = REWIND_INTERVAL;
+
+		if (!bHasLatest) {
+			Snapshot::Capture(latest);
+			bHasLatest = true;
+		} else {
+			Snapshot::Capture(pending);
+			bEncoding = true;
+			encodePos = 0;
+			encodedWords = 1;
+			runHeader = 0;
+			zeroWords = 0;
+			literalWords = 0;
+		}
+	}
+}
+
+bool nes_rewind::stepBack() {
+	// whatever was being captured is newer than where this goes back to
+	bEncoding = false;
+	framesUntilCapture = REWIND_INTERVAL;
+
+	if (!bHasLatest) {
+		return false;
+	}
+
+	// the first step goes back to the newest point, then each one after goes to the point before
+	bool bStepped = true;
+	if (bAtLatest) {
+		if (numEntries) {
+			popEntry();
+		} else {
+			bStepped = false;
+		}
+	}
+
+	if (!Snapshot::Restore(latest)) {
+		reset();
+		return false;
+	}
+
+	bAtLatest = true;
+	return bStepped;
+}
+
+// Run length encodes pending XOR latest as a zero word count and literal word count packed in a header word, followed
+// by the literal words. Runs are split when either count would pass 16 bits
+void nes_rewind::encode(uint32 endPos) {
+	const uint32* cur = (const uint32*) pending;
+	const uint32* prev = (const uint32*) latest;
+
+	for (uint32 i = encodePos; i < endPos; i++) {
+		uint32 delta = cur[i] ^ prev[i];
+		if (delta == 0) {
+			if (literalWords || zeroWords == 0xFFFF) {
+				encoded[runHeader] = zeroWords | (literalWords << 16);
+				runHeader = encodedWords++;
+				zeroWords = 0;
+				literalWords = 0;
+			}
+			zeroWords++;
+		} else {
+			if (literalWords == 0xFFFF) {
+				encoded[runHeader] = zeroWords | (literalWords << 16);
+				runHeader = encodedWords++;
+				zeroWords = 0;
+				literalWords = 0;
+			}
+			encoded[encodedWords++] = delta;
+			literalWords++;
+		}
+	}
+
+	encodePos = endPos;
+}
+
+void nes_rewind::pushEntry() {
+	const uint32 entryWords = encodedWords + 2;
+	if (entryWords > ringWords) {
+		// every older point is reached through this one
+		numEntries = 0;
+		head = tail = 0;
+		return;
+	}
+
+	// entries run from tail to head, or from tail to wrapEnd and then from the start to head once wrapped
+	for (;;) {
+		if (numEntries == 0) {
+			head = tail = 0;
+			break;
+		}
+
+		if (tail < head) {
+			if (head + entryWords <= ringWords) {
+				break;
+			}
+			wrapEnd = head;
+			head = 0;
+		}
+
+		if (head + entryWords <= tail) {
+			break;
+		}
+		dropOldest();
+	}
+
+	ring[head] = encodedWords;
+	memcpy(&ring[head + 1], encoded, encodedWords * 4);
+	ring[head + encodedWords + 1] = encodedWords;
+	head += entryWords;
+	numEntries++;
+}
+
+// applies the newest delta to latest and removes it
+void nes_rewind::popEntry() {
+	DebugAssert(numEntries > 0);
+
+	if (head == 0) {
+		head = wrapEnd;
+	}
+
+	const uint32 words = ring[head - 1];
+	head -= words + 2;
+
+	uint32* snapshot = (uint32*) latest;
+	const uint32* in = &ring[head + 1];
+	const uint32* end = in + words;
+	while (in < end) {
+		const uint32 header = *in++;
+		snapshot += header & 0xFFFF;
+		for (uint32 i = header >> 16; i; i--) {
+			*snapshot++ ^= *in++;
+		}
+	}
+
+	if (--numEntries == 0) {
+		head = tail = 0;
+	}
+}
+
+void nes_rewind::dropOldest() {
+	tail += ring[tail] + 2;
+	if (tail == wrapEnd && head <= tail) {
+		tail = 0;
+	}
+
+	if (--numEntries == 0) {
+		head = tail = 0;
+	}
+}
@@ -0,0 +1,81 @@
+
+// Run ahead input lag reduction (see nes_runahead in nes.h)
+
+#include "platform.h"
+#include "debug.h"
+#include "nes.h"
+#include "settings.h"
+#include "scope_timer/scope_timer.h"
+
+MACHINE_STATE nes_runahead nesRunAhead;
+
+void nes_runahead::reset() {
+	// snapshot size depends on the cart
+	if (state) {
+		free(state);
+		state = NULL;
+	}
+
+	frames = 0;
+	framesLeft = 0;
+	bRunning = false;
+	bShownSkipped = false;
+	cycles = 0;
+	numRuns = 0;
+}
+
+bool nes_runahead::filterSkipFrame(bool bSkipFrame) {
+	if (bRunning) {
+		return framesLeft == 1 ? bShownSkipped : true;
+	}
+
+	frames = nesSettings.GetSetting(ST_RunAhead);
+	if (frames && !state) {
+		state = (uint8*) malloc(Snapshot::GetSize());
+		if (!state) {
+			printf("No memory for run ahead");
+			nesSettings.SetSetting(ST_RunAhead, 0);
+			frames = 0;
+		}
+	}
+
+	if (frames == 0) {
+		return bSkipFrame;
+	}
+
+	// the real frame is replaced by the last one run ahead
+	bShownSkipped = bSkipFrame;
+	return true;
+}
+
+void nes_runahead::run() {
+	TIME_SCOPE();
+
+	DebugAssert(!bRunning && state);
+	const unsigned int startCycles = GetCycles();
+
+	Snapshot::Capture(state);
+
+	// the PPU event for the next scanline is queued after nes_ppu::step returns, which is still to come
+	mainCPU.events.schedule(CPU_EVENT_PPU, mainCPU.ppuClocks);
+
+	// same loop as the frontend, a frame ends with the PPU step for scanline 242
+	bRunning = true;
+	for (framesLeft = frames; framesLeft; ) {
+		const unsigned int scanline = nesPPU.scanline;
+		cpu6502_Step();
+		mainCPU.dispatchEvents();
+		if (scanline == 242 && nesPPU.scanline == 243) {
+			framesLeft--;
+		}
+	}
+	bRunning = false;
+
+	Snapshot::Restore(state);
+
+	cycles += startCycles - GetCycles();
+	numRuns++;
+
+	// frame timing waits here, after the machine is back, so sound is mixed from the real frame
+	nesPPU.finishFrame(bShownSkipped);
+}
@@ -183,6 +183,8 @@ struct FCEUX_File {
 				HandleSubsection(ST_EXTRA, IRQA, 1);
 				HandleSubsection(ST_EXTRA, RMOD, 1);
 				HandleSubsection(ST_EXTRA, IRQM, 1);
+				// Sunsoft 3
+				HandleSubsection(ST_EXTRA, IRQS, 8);
 				// MMC2 / AVE
 				if (nesCart.mapper == 79) {
 					HandleSubsection(ST_EXTRA, CREG, 1);
@@ -243,6 +245,9 @@ struct FCEUX_File {
 	// nametable RAM
 	inline void Read_ST_PPU_NTAR(uint8* data, uint32 size) {
 		nes_nametable* curTable = nesPPU.nameTables;
+#if BACKGROUND_LINE_CACHE
+		nesPPU.invalidateBackgroundLines();
+#endif
 		while (size) {
 			memcpy(curTable, data, 0x400);
 			data += 0x400;
@@ -313,8 +318,12 @@ struct FCEUX_File {
 
 	void Read_ST_EXTRA_CHRR(uint8* data, uint32 size) {
 		if (nesCart.numCHRBanks == 0) {
-			memcpy(nesPPU.chrPages[0], data, 0x1000);
-			memcpy(nesPPU.chrPages[1], data + 0x1000, 0x1000);
+			for (int32 i = 0; i < 8; i++) {
+				memcpy(nesPPU.chrPages[i], data + 0x400 * i, 0x400);
+			}
+#if DECODED_TILE_CACHE
+			nesPPU.invalidateDecodedTiles();
+#endif
 		}
 	}
 
@@ -458,6 +467,9 @@ struct FCEUX_File {
 			for (int32 r = 0; r < 9; r++) {
 				nesCart.registers[r] = data[r];
 			}
+
+			// states from before IRQS was written count the IRQ from the load
+			Mapper67_IRQ_LastSet = mainCPU.clocks;
 		}
 		// Nanjing
 		else if (nesCart.mapper == 163) {
@@ -474,6 +486,10 @@ struct FCEUX_File {
 				EndianSwap_Big(regs[r]);
 				nesCart.registers[r] = regs[r];
 			}
+
+			// clock timestamps are saved as their low 32 bits, expand them back relative to the current clock
+			Mapper69_IRQ = regs[18] ? mainCPU.clocks + (int32) (regs[18] - (uint32) mainCPU.clocks) : 0;
+			Mapper69_LASTCOUNTERCLK = regs[20] ? mainCPU.clocks + (int32) (regs[20] - (uint32) mainCPU.clocks) : 0;
 		}
 		// BNROM
 		else if (nesCart.mapper == 34) {
@@ -511,6 +527,20 @@ struct FCEUX_File {
 		}
 	}
 
+	void Read_ST_EXTRA_IRQS(uint8* data, uint32 size) {
+		// Sunsoft 3 (not FCEUX compatible)
+		if (nesCart.mapper == 67) {
+			uint32 irq[2];
+			memcpy(irq, data, 8);
+			EndianSwap_Big(irq[0]);
+			EndianSwap_Big(irq[1]);
+
+			// the CPU clock is not part of the state, so the counter was saved as clocks since it was set
+			Mapper67_IRQ_LastSet = mainCPU.clocks - irq[0];
+			Mapper67_IRQ_Counter = irq[1];
+		}
+	}
+
 	void Read_ST_EXTRA_IRQR(uint8* data, uint32 size) {
 		// MMC3
 		if (nesCart.mapper == 4) {
@@ -808,6 +838,14 @@ struct FCEUX_File {
 					regs[r] = nesCart.registers[r];
 				}
 				WriteChunk_Data("REGS", 9, regs);
+
+				// the IRQ clock lives outside the registers and the counter is 16 bit, so neither fits REGS
+				if (nesCart.mapper == 67) {
+					uint32 irq[2] = { (uint32) (mainCPU.clocks - Mapper67_IRQ_LastSet), Mapper67_IRQ_Counter };
+					EndianSwap_Big(irq[0]);
+					EndianSwap_Big(irq[1]);
+					WriteChunk_Data("IRQS", 8, irq);
+				}
 			}
 			// GXROM Mapper
 			else if (nesCart.mapper == 66 || nesCart.mapper == 140) {
@@ -818,6 +856,10 @@ struct FCEUX_File {
 				uint32 regs[21];
 				for (int32 r = 0; r < 21; r++) {
 					regs[r] = nesCart.registers[r];
+				}
+				regs[18] = (uint32) Mapper69_IRQ;
+				regs[20] = (uint32) Mapper69_LASTCOUNTERCLK;
+				for (int32 r = 0; r < 21; r++) {
 					EndianSwap_Big(regs[r]);
 				}
 				WriteChunk_Data("REGS", 84, regs);
@@ -840,7 +882,7 @@ struct FCEUX_File {
 
 			// chr ram expected if there are no chr banks in the ROM
 			if (nesCart.numCHRBanks == 0) {
-				DebugAssert(nesPPU.chrPages[0] + 4096 == nesPPU.chrPages[1]);
+				DebugAssert(nesPPU.chrPages[0] + 0x1C00 == nesPPU.chrPages[7]);
 				WriteChunk_Data("CHRR", 8192, nesPPU.chrPages[0]);
 			}
 		}
@@ -970,13 +1012,14 @@ bool nes_cart::LoadState() {
 		nesCart.CommitChrBanks();
 	}
 
-	return fceuxFile.hasError;
+	return !fceuxFile.hasError;
 }
 
 void nes_cart::FlushCache() {
 	for (int32 i = 0; i < cachedBankCount; i++) {
 		cache[i].clear();
 	}
+	resetBankLookup();
 
 	for (int32 i = 0; i < 4 + isLowPRGROM; i++) {
 		int curBank = programBanks[i];
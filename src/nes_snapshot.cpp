@@ -0,0 +1,212 @@
+
+// In-memory machine snapshots (see Snapshot in nes.h)
+
+#include "platform.h"
+#include "debug.h"
+#include "nes.h"
+#include "mappers.h"
+
+extern MACHINE_STATE unsigned char curStrobe;
+extern MACHINE_STATE unsigned int buttonMarch1;
+extern MACHINE_STATE unsigned int buttonMarch2;
+
+extern MACHINE_STATE nes_nametable nes_onboardPPUTables[4];
+
+// identifies the cart and build a snapshot belongs to
+struct nes_snapshot_header {
+	char magic[4];
+	uint32 version;
+	uint32 size;
+	int32 mapper;
+	int32 numPRGBanks;
+	int32 numCHRBanks;
+	int32 cachedBankCount;
+	int32 allocatedROMBanks;
+};
+
+// mapper state and memory map of the cart
+struct nes_snapshot_cart {
+	unsigned int registers[32];
+	uint64 clockRegisters[4];
+	int32 programBanks[5];
+	int16 chrBanks[8];
+	bool bDirtyChrBanks;
+	bool bSwapChrPages;
+	void(*writeSpecial)(unsigned int address, unsigned char value);
+	void(*renderLatch)(unsigned int ppuAddress);
+	void(*scanlineClock)();
+};
+
+struct nes_snapshot_input {
+	unsigned int curStrobe;
+	unsigned int buttonMarch1;
+	unsigned int buttonMarch2;
+};
+
+// offsets of each part, padded to 32 bytes so RAM banks can use memcpy_fast32
+#define SNAPSHOT_ALIGN(x) (((x) + 31) & ~31)
+#define SNAPSHOT_CPU SNAPSHOT_ALIGN(sizeof(nes_snapshot_header))
+#define SNAPSHOT_PPU SNAPSHOT_ALIGN(SNAPSHOT_CPU + sizeof(nes_cpu))
+#define SNAPSHOT_APU SNAPSHOT_ALIGN(SNAPSHOT_PPU + sizeof(nes_ppu))
+#define SNAPSHOT_CART SNAPSHOT_ALIGN(SNAPSHOT_APU + sizeof(nes_apu))
+#define SNAPSHOT_NAMETABLES SNAPSHOT_ALIGN(SNAPSHOT_CART + sizeof(nes_snapshot_cart))
+#define SNAPSHOT_INPUT SNAPSHOT_ALIGN(SNAPSHOT_NAMETABLES + sizeof(nes_onboardPPUTables))
+#define SNAPSHOT_BANKS SNAPSHOT_ALIGN(SNAPSHOT_INPUT + sizeof(nes_snapshot_input))
+
+// cache[] copies for the ROM banks, followed by the RAM banks
+static uint32 ramBanksOffset() {
+	return SNAPSHOT_ALIGN(SNAPSHOT_BANKS + nesCart.cachedBankCount * sizeof(nes_cached_bank));
+}
+
+uint32 Snapshot::GetSize() {
+	return ramBanksOffset() + (nesCart.allocatedROMBanks - nesCart.cachedBankCount) * 8192;
+}
+
+uint32 Snapshot::Capture(uint8* buffer) {
+	TIME_SCOPE();
+
+	// clears the padding between parts so equal machines give equal snapshots (rewind deltas rely on this)
+	memset(buffer, 0, SNAPSHOT_BANKS);
+
+	nes_snapshot_header* header = (nes_snapshot_header*) buffer;
+	memcpy(header->magic, "NZSS", 4);
+	header->version = SNAPSHOT_VERSION;
+	header->size = GetSize();
+	header->mapper = nesCart.mapper;
+	header->numPRGBanks = nesCart.numPRGBanks;
+	header->numCHRBanks = nesCart.numCHRBanks;
+	header->cachedBankCount = nesCart.cachedBankCount;
+	header->allocatedROMBanks = nesCart.allocatedROMBanks;
+
+	memcpy(buffer + SNAPSHOT_CPU, &mainCPU, sizeof(nes_cpu));
+	memcpy(buffer + SNAPSHOT_PPU, &nesPPU, sizeof(nes_ppu));
+	memcpy(buffer + SNAPSHOT_APU, &nesAPU, sizeof(nes_apu));
+
+	nes_snapshot_cart* cart = (nes_snapshot_cart*) (buffer + SNAPSHOT_CART);
+	memcpy(cart->registers, nesCart.registers, sizeof(cart->registers));
+	memcpy(cart->clockRegisters, nesCart.clockRegisters, sizeof(cart->clockRegisters));
+	memcpy(cart->programBanks, nesCart.programBanks, sizeof(cart->programBanks));
+	memcpy(cart->chrBanks, nesCart.chrBanks, sizeof(cart->chrBanks));
+	cart->bDirtyChrBanks = nesCart.bDirtyChrBanks;
+	cart->bSwapChrPages = nesCart.bSwapChrPages;
+	cart->writeSpecial = nesCart.writeSpecial;
+	cart->renderLatch = nesCart.renderLatch;
+	cart->scanlineClock = nesCart.scanlineClock;
+
+	memcpy(buffer + SNAPSHOT_NAMETABLES, nes_onboardPPUTables, sizeof(nes_onboardPPUTables));
+
+	nes_snapshot_input* input = (nes_snapshot_input*) (buffer + SNAPSHOT_INPUT);
+	input->curStrobe = curStrobe;
+	input->buttonMarch1 = buttonMarch1;
+	input->buttonMarch2 = buttonMarch2;
+
+	// which bank each part of cache[] held, so pointers into it can be found again if it changes before restoring
+	memcpy(buffer + SNAPSHOT_BANKS, nesCart.cache, nesCart.cachedBankCount * sizeof(nes_cached_bank));
+
+	uint8* ram = buffer + ramBanksOffset();
+	for (int i = nesCart.cachedBankCount; i < nesCart.allocatedROMBanks; i++, ram += 8192) {
+		memcpy_fast32(ram, nesCart.cache[i].ptr, 8192);
+	}
+
+	return header->size;
+}
+
+bool Snapshot::Restore(const uint8* buffer) {
+	TIME_SCOPE();
+
+	const nes_snapshot_header* header = (const nes_snapshot_header*) buffer;
+	if (memcmp(header->magic, "NZSS", 4) || header->version != SNAPSHOT_VERSION || header->size != GetSize() ||
+		header->mapper != nesCart.mapper || header->numPRGBanks != nesCart.numPRGBanks ||
+		header->numCHRBanks != nesCart.numCHRBanks || header->cachedBankCount != nesCart.cachedBankCount ||
+		header->allocatedROMBanks != nesCart.allocatedROMBanks) {
+		return false;
+	}
+
+	memcpy(&mainCPU, buffer + SNAPSHOT_CPU, sizeof(nes_cpu));
+
+	// the scanline buffer, frame skip and colors belong to the display, not the machine
+	uint8* scanlineBuffer = nesPPU.scanlineBuffer;
+	unsigned int autoFrameSkip = nesPPU.autoFrameSkip;
+	unsigned short rgbPalette[64];
+	memcpy(rgbPalette, nesPPU.rgbPalette, sizeof(rgbPalette));
+
+	memcpy(&nesPPU, buffer + SNAPSHOT_PPU, sizeof(nes_ppu));
+
+	nesPPU.scanlineBuffer = scanlineBuffer;
+	nesPPU.autoFrameSkip = autoFrameSkip;
+	memcpy(nesPPU.rgbPalette, rgbPalette, sizeof(rgbPalette));
+	nesPPU.dirtyPalette = true;
+
+	memcpy(&nesAPU, buffer + SNAPSHOT_APU, sizeof(nes_apu));
+
+	const nes_snapshot_cart* cart = (const nes_snapshot_cart*) (buffer + SNAPSHOT_CART);
+	memcpy(nesCart.registers, cart->registers, sizeof(cart->registers));
+	memcpy(nesCart.clockRegisters, cart->clockRegisters, sizeof(cart->clockRegisters));
+	memcpy(nesCart.programBanks, cart->programBanks, sizeof(cart->programBanks));
+	memcpy(nesCart.chrBanks, cart->chrBanks, sizeof(cart->chrBanks));
+	nesCart.bDirtyChrBanks = cart->bDirtyChrBanks;
+	nesCart.bSwapChrPages = cart->bSwapChrPages;
+	nesCart.writeSpecial = cart->writeSpecial;
+	nesCart.renderLatch = cart->renderLatch;
+	nesCart.scanlineClock = cart->scanlineClock;
+
+	memcpy(nes_onboardPPUTables, buffer + SNAPSHOT_NAMETABLES, sizeof(nes_onboardPPUTables));
+
+	const nes_snapshot_input* input = (const nes_snapshot_input*) (buffer + SNAPSHOT_INPUT);
+	curStrobe = input->curStrobe;
+	buttonMarch1 = input->buttonMarch1;
+	buttonMarch2 = input->buttonMarch2;
+
+	// the memory map points into cache[], so anything mapped from a bank that has been replaced since needs to be
+	// found again (usually nothing, and never with the ROM file mapped directly)
+	const nes_cached_bank* banks = (const nes_cached_bank*) (buffer + SNAPSHOT_BANKS);
+	bool bBanksChanged = false;
+	for (int i = 0; i < nesCart.cachedBankCount && !bBanksChanged; i++) {
+		bBanksChanged = !nesCart.holdsSameBank(i, banks[i]);
+	}
+
+	if (bBanksChanged) {
+		// page biased, see nes_cpu::setMap
+		for (unsigned int i = 0; i < 0x101; i++) {
+			unsigned char* ptr = mainCPU._map[i] + (i << 8);
+			mainCPU._map[i] = nesCart.relocateBankPointer(ptr, banks) - (i << 8);
+		}
+
+#if PREDECODE_INSTRUCTIONS
+		for (unsigned int i = 0; i < 8; i++) {
+			if (mainCPU.predecode[i]) {
+				mainCPU.predecode[i] = nesCart.getPredecodeRecords(mainCPU.getNonIOMem(i << 13));
+			}
+		}
+#endif
+
+		for (int i = 0; i < 8; i++) {
+			nesPPU.chrPages[i] = nesCart.relocateBankPointer(nesPPU.chrPages[i], banks);
+		}
+
+		// PRG banks filled again above still need their Game Genie codes
+		nesCart.applySlotPatches(0x0F);
+	}
+
+	const uint8* ram = buffer + ramBanksOffset();
+	for (int i = nesCart.cachedBankCount; i < nesCart.allocatedROMBanks; i++, ram += 8192) {
+		memcpy_fast32(nesCart.cache[i].ptr, ram, 8192);
+	}
+
+	// battery backed RAM is compared against the .sav file when it is next saved
+	if (nesCart.numRAMBanks >= 1) {
+		nesCart.wramDirtyPages = 0xFFFFFFFF;
+	}
+
+#if DECODED_TILE_CACHE
+	if (nesCart.numCHRBanks == 0) {
+		// CHR RAM was overwritten
+		nesPPU.invalidateDecodedTiles();
+	}
+#endif
+#if BACKGROUND_LINE_CACHE
+	nesPPU.invalidateBackgroundLines();
+#endif
+
+	return true;
+}
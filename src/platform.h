@@ -3,7 +3,12 @@
 #include "stdio.h"
 #include "string.h"
 #include "stdlib.h"
+#include "stdint.h"
 
+#if TARGET_HOST
+// POSIX replacements for the fxcg SDK calls used by the emulation core
+#include "host/host_platform.h"
+#else
 #include "fxcg\display.h"
 #include "fxcg\keyboard.h"
 #include "fxcg\file.h"
@@ -11,6 +16,7 @@
 #include "fxcg\rtc.h"
 #include "fxcg\system.h"
 #include "fxcg\serial.h"
+#endif
 
 typedef signed char int8;
 typedef unsigned char uint8;
@@ -18,21 +24,38 @@ typedef signed short int16;
 typedef unsigned short uint16;
 typedef signed int int32;
 typedef unsigned int uint32;
+typedef signed long long int64;
+typedef unsigned long long uint64;
 
 #if TARGET_WINSIM
 #define ALIGN(x) alignas(x)
 #define LITTLE_E
 #define FORCE_INLINE __forceinline
+#define NOINLINE __declspec(noinline)
 #define RESTRICT __restrict
+#define MACHINE_STATE
 #include <time.h>
 #undef LoadImage
+#elif TARGET_HOST
+#define ALIGN(x) __attribute__((aligned(x)))
+#define LITTLE_E
+#define FORCE_INLINE __attribute__((always_inline)) inline
+#define NOINLINE __attribute__((noinline))
+#define RESTRICT __restrict__
+// each thread emulates its own machine, so batch runs can use every core in one process. Machine state has no
+// constructors (it starts zeroed like any static), since a thread_local that needs one is reached through a call from
+// every other file; Makefile.host promises this to the compiler with -fno-extern-tls-init
+#define MACHINE_STATE thread_local
+#include <time.h>
 #else
 
 #define ALIGN(x) __attribute__((aligned(x)))
 #define BIG_E
 #define override
 #define FORCE_INLINE __attribute__((always_inline)) inline
+#define NOINLINE __attribute__((noinline))
 #define RESTRICT __restrict__
+#define MACHINE_STATE
 #include "fxcg_registers.h"
 #define nullptr NULL
 
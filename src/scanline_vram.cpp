@@ -8,12 +8,17 @@
 #include "settings.h"
 #include "imageDraw.h"
 #include "frontend.h"
+#include "scope_timer/scope_timer.h"
 
 // used for direct render of frame count
+#if !TARGET_HOST
 #include "calctype/calctype.h"
 #include "calctype/fonts/arial_small/arial_small.h"	
+#else
+#include "host_simd.h"
+#endif
 
-static unsigned char scanlineBufferMem[256 + 16 * 2] = { 0 }; 
+static MACHINE_STATE unsigned char scanlineBufferMem[256 + 16 * 2] = { 0 }; 
 
 void nes_ppu::initScanlineBuffer() {
 	nesPPU.scanlineBuffer = scanlineBufferMem;
@@ -23,11 +28,25 @@ void nes_ppu::resolveScanline(int scrollOffset) {
 	TIME_SCOPE();
 
 	if (nesPPU.scanline >= 13 && nesPPU.scanline <= 228) {
+#if TARGET_HOST
+		// resolve the whole visible line with the vector kernels, then stretch from the colors
+		uint16 colors[240];
+		if (nesSettings.GetSetting(ST_StretchScreen) == 0) {
+			Host_ResolvePalette(((unsigned short*)GetVRAMAddress()) + (nesPPU.scanline - 13) * 384 + 72 + scanlineOffset,
+				&nesPPU.scanlineBuffer[8 + scrollOffset], workingPalette, 240);
+			return;
+		}
+		Host_ResolvePalette(colors, &nesPPU.scanlineBuffer[8 + scrollOffset], workingPalette, 240);
+#endif
+
 		if (nesSettings.GetSetting(ST_StretchScreen) == 1) {
 			unsigned short* scanlineDest = ((unsigned short*)GetVRAMAddress()) + (nesPPU.scanline - 13) * 384 + 42 + scanlineOffset;
 			unsigned char* scanlineSrc = &nesPPU.scanlineBuffer[8 + scrollOffset];	// with clipping
 			const int interlacePixel = (nesPPU.frameCounter + nesPPU.scanline) & 3;
 			for (int i = 0; i < 60; i++) {
+#if TARGET_HOST
+				const uint16* pixel = &colors[i * 4];
+#else
 				const uint16 pixels[4] = {
 					workingPalette[(*scanlineSrc++) >> 1],
 					workingPalette[(*scanlineSrc++) >> 1],
@@ -35,6 +54,7 @@ void nes_ppu::resolveScanline(int scrollOffset) {
 					workingPalette[(*scanlineSrc++) >> 1]
 				};
 				const uint16* pixel = pixels;
+#endif
 				for (int j = 0; j < 5; j++) {
 					*(scanlineDest++) = *pixel;
 					if (j != interlacePixel) pixel++;
@@ -45,8 +65,13 @@ void nes_ppu::resolveScanline(int scrollOffset) {
 			unsigned char* scanlineSrc = &nesPPU.scanlineBuffer[8 + scrollOffset];	// with clipping
 			const bool bInterlace = (nesPPU.frameCounter + nesPPU.scanline) & 1;
 			for (int i = 0; i < 120; i++) {
+#if TARGET_HOST
+				const uint16 pixel1 = colors[i * 2];
+				const uint16 pixel2 = colors[i * 2 + 1];
+#else
 				const uint16 pixel1 = workingPalette[(*scanlineSrc++) >> 1];
 				const uint16 pixel2 = workingPalette[(*scanlineSrc++) >> 1];
+#endif
 				*(scanlineDest++) = pixel1;
 				*(scanlineDest++) = bInterlace ? pixel1 : pixel2;
 				*(scanlineDest++) = pixel2;
@@ -103,7 +128,7 @@ void nes_ppu::finishFrame(bool bSkippedFrame) {
 		return;
 	}
 
-#if DEBUG
+#if DEBUG && !TARGET_HOST
 	char buffer[32];
 	sprintf(buffer, "%d   ", frameCounter);
 	int x = 2;
@@ -120,6 +145,14 @@ void nes_ppu::finishFrame(bool bSkippedFrame) {
 	Bdisp_PutDisp_DD();
 }
 
+// headless host builds have no frontend to draw the overlays with
+#if TARGET_HOST
+void nes_ppu::renderClock() {
+}
+
+void nes_ppu::renderFPS(int32 fps) {
+}
+#else
 void nes_ppu::renderClock() {
 	unsigned short clockData[CLOCK_WIDTH * CLOCK_HEIGHT];
 	PrizmImage clockImage = {
@@ -156,4 +189,6 @@ void nes_ppu::renderFPS(int32 fps) {
 	clockImage.Draw_Blit(378 - CLOCK_WIDTH, y);
 }
 
+#endif
+
 #endif
\ No newline at end of file
@@ -5,12 +5,17 @@
 #include "../platform.h"
 #include "scope_timer.h"
 
+#if !TARGET_HOST
 #include "calctype/calctype.h"
 #include "calctype/fonts/arial_small/arial_small.h"	
+#endif
 
 #if TARGET_WINSIM
 unsigned int ScopeTimer_FrameCycles = 0;
 LONGLONG ScopeTimer_Start = 0;
+#elif TARGET_HOST
+// GetCycles counts 16 ns units on host
+unsigned int ScopeTimer_FrameCycles = 1000000000 / 16 / 60;
 #else
 #include "ptune2_simple/Ptune2_direct.h"
 #endif
@@ -116,6 +121,11 @@ void ScopeTimer::Shutdown() {
 #endif
 }
 
+#if TARGET_HOST
+static void PrintInfo(int row, const char* label, const char* info, unsigned short color) {
+	printf("%-40s %s\n", label, info);
+}
+#else
 static void PrintInfo(int row, const char* label, const char* info, unsigned short color) {
 	// location of columns
 	const int col1 = 0;
@@ -129,10 +139,10 @@ static void PrintInfo(int row, const char* label, const char* info, unsigned sho
 	y = row * 15 + 2;
 	CalcType_Draw(&arial_small, info, x, y, color, 0, 0);
 }
+#endif
 
 void ScopeTimer::DisplayTimes() {
 	// display debug view with get key
-	int toKey;
 	unsigned int maxCycles = 0;
 	unsigned int maxCount = 0;
 
@@ -202,6 +212,23 @@ void ScopeTimer::DisplayTimes() {
 		}
 	}
 
+#if TARGET_HOST
+	// no interactive view on host, dump the percentage and cycles per hit of every timer
+	PrintInfo(0, "Function(line)", "% Max / Cycles/Hit", COLOR_WHITE);
+	for (int timer = 0; timer < numTimers; timer++) {
+		ScopeTimer* curTimer = timers[timer];
+
+		char name[256];
+		sprintf(name, "%s(%d)", curTimer->funcName, curTimer->line);
+
+		int percent = maxCycles >= 1000 ? curTimer->cycleCount / (maxCycles / 1000) : 0;
+		char info[256];
+		sprintf(info, "%d.%d / %d", percent / 10, percent % 10, curTimer->numCounts ? curTimer->cycleCount / curTimer->numCounts : 0);
+		PrintInfo(timer + 1, name, info, COLOR_WHITE);
+	}
+	(void) modeNames;
+#else
+	int toKey;
 	int startTimer = 0;
 	int mode = 0;
 
@@ -296,6 +323,7 @@ void ScopeTimer::DisplayTimes() {
 		}
 	// wait for exit key
 	} while (toKey != KEY_CTRL_EXIT);
+#endif
 
 #if TARGET_PRIZM
 	// enable TMU2
@@ -3,6 +3,14 @@
 #if TARGET_PRIZM
 #include "tmu.h"
 #define GetCycles() REG_TMU_TCNT_2
+#elif TARGET_HOST
+#include <time.h>
+// counts down like the TMU, in 16 ns units so a single scope still fits the 16 bit AddTime
+inline unsigned int GetCycles() {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return 0u - (unsigned int) ((now.tv_sec * 1000000000ull + now.tv_nsec) >> 4);
+}
 #else
 #include <windows.h>
 extern LONGLONG ScopeTimer_Start;
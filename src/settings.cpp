@@ -3,7 +3,7 @@
 
 #include "settings.h"
 
-EmulatorSettings nesSettings;
+MACHINE_STATE EmulatorSettings nesSettings;
 
 struct SettingInfo {
 	SettingType type;
@@ -26,6 +26,8 @@ struct SettingInfo {
 			[Auto, 0, 1, 2, 3, 4]
 		Speed - What target speed to emulate at. Can be useful to make some games easier to play
 			[Unclamped, 100%, 90%, 80%, 50%]
+		Run Ahead - Frames to run ahead of the shown frame to hide the game's own input lag
+			[Off, 1, 2, 3]
 		Back - Return to Options
 	Controls
 		Remap Keys - Map the controller buttons to new keys
@@ -110,6 +112,13 @@ static const char* ClockOptions[] = {
 	"12 Hour",
 };
 
+static const char* RunAheadOptions[] = {
+	"Off",
+	"1 Frame",
+	"2 Frames",
+	"3 Frames",
+};
+
 static SettingInfo infos[] = {
 	{ ST_AutoSave,			SG_Deprecated,	false,	0,	2,	"Auto Save",		OffOn,				""}, // decided to go with always auto SRAM save, manual state save
 	{ ST_OverClock,			SG_System,		true,   0,  3,  "Overclock",		OverclockOptions,	"Increase calculator clock speed to\nimprove performance (costs battery)"},
@@ -127,6 +136,8 @@ static SettingInfo infos[] = {
 	{ ST_Brightness,		SG_Video,		true,	5, 11,  "Brightness",		nullptr,			""},
 	{ ST_Color,				SG_Video,		true,	5, 11,  "Color",			nullptr,			""},
 	{ ST_ShowFPS,			SG_System,		true,	0,  2,  "Show FPS",			OffOn,				"Enable to show current frames\nper second in bottom right."},
+	{ ST_SpriteLimit,		SG_Video,		true,	0,  2,  "Sprite Limit",		OffOn,				"Limit to 8 sprites per line like\nthe NES (flickers, fixes hidden\nsprites in some games)"},
+	{ ST_RunAhead,			SG_System,		true,	0,  4,  "Run Ahead",		RunAheadOptions,	"Frames to run ahead to hide the\ngame's own input lag (each frame\ncosts about a frame of speed)"},
 };
 
 const char* EmulatorSettings::GetSettingName(SettingType setting) {
@@ -175,6 +186,7 @@ void EmulatorSettings::SetDefaults() {
 	keyMap[NES_FASTFORWARD] = 57;	// '^'
 	keyMap[NES_VOL_UP] = 42;	// '+'
 	keyMap[NES_VOL_DOWN] = 32;	// '-'
+	keyMap[NES_REWIND] = 53;		// 'R'
 
 	// simulator only defaults
 #if TARGET_WINSIM
@@ -213,11 +225,14 @@ void EmulatorSettings::Load() {
 				uint8 value = contents[cur++];
 				values[setting] = value;
 			}
+			// settings from before newer keys were added keep the defaults for those
 			uint8 numKeys = contents[cur++];
-			if (numKeys == NES_MAX_KEYS) {
-				for (int i = 0; i < NES_MAX_KEYS; i++) {
+			if (numKeys <= NES_MAX_KEYS) {
+				for (int i = 0; i < numKeys; i++) {
 					keyMap[i] = contents[cur++];
 				}
+			} else {
+				cur += numKeys;
 			}
 
 			// if a continue file is specified, validate that it still exists
@@ -300,5 +315,10 @@ void EmulatorSettings::Save() {
 	DebugAssert(size < 256);
 
 	MCS_CreateDirectory((unsigned char*)settingsDir);
+#if TARGET_HOST
+	// the host shim takes the buffer as a pointer, the SDK takes its address as an int
+	MCS_WriteItem((unsigned char*)settingsDir, (unsigned char*)settingsFile, 0, size, &contents[0]);
+#else
 	MCS_WriteItem((unsigned char*)settingsDir, (unsigned char*)settingsFile, 0, size, (int)(&contents[0]));
+#endif
 }
\ No newline at end of file
@@ -20,6 +20,8 @@ enum SettingType {
 	ST_Brightness,
 	ST_Color,
 	ST_ShowFPS,
+	ST_SpriteLimit,
+	ST_RunAhead,
 
 	MAX_SETTINGS
 };
@@ -34,10 +36,6 @@ enum SettingGroup {
 };
 
 struct GameGenieCode {
-	GameGenieCode() {
-		clear();
-	}
-
 	// return false if invalid code is set
 	bool set(const char* withValue);
 	void clear();
@@ -96,6 +94,10 @@ struct EmulatorSettings {
 
 	void IncSetting(SettingType type);
 
+	void SetSetting(SettingType type, int value) {
+		values[type] = value;
+	}
+
 	const char* GetContinueFile();
 	void SetContinueFile(const char* romFile);
 
@@ -112,4 +114,4 @@ private:
 	char continueFile[48];
 };
 
-extern EmulatorSettings nesSettings;
\ No newline at end of file
+extern MACHINE_STATE EmulatorSettings nesSettings;
\ No newline at end of file
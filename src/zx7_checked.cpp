@@ -0,0 +1,101 @@
+// ZX7 decompression for data that comes from outside the add-in. The SDK zx7 library trusts its input, which is fine for
+// the compressed images built into it but not for a .nz7 ROM file
+
+#include "platform.h"
+#include "zx7_checked.h"
+
+#define ZX7_SHORT_OFFSET 128
+
+struct zx7_reader {
+	const unsigned char* src;
+	const unsigned char* srcEnd;
+	int bitMask;
+	int bitValue;
+	bool bOverrun;			// read past srcEnd, reads there return 0
+
+	int readByte() {
+		if (src == srcEnd) {
+			bOverrun = true;
+			return 0;
+		}
+		return *src++;
+	}
+
+	int readBit() {
+		bitMask >>= 1;
+		if (bitMask == 0) {
+			bitMask = 128;
+			bitValue = readByte();
+		}
+		return (bitValue & bitMask) ? 1 : 0;
+	}
+
+	// returns -1 for the end marker (16 zero bits), which also stops a stream that ran out
+	int readEliasGamma() {
+		int bits = 0;
+		while (!readBit()) {
+			if (++bits > 15) {
+				return -1;
+			}
+		}
+
+		int value = 1;
+		while (bits--) {
+			value = (value << 1) | readBit();
+		}
+		return value;
+	}
+};
+
+bool ZX7DecompressChecked(const unsigned char* src, unsigned int srcSize, unsigned char* dest, unsigned int size) {
+	if (size == 0 || srcSize == 0) {
+		return false;
+	}
+
+	zx7_reader reader;
+	reader.src = src;
+	reader.srcEnd = src + srcSize;
+	reader.bitMask = 0;
+	reader.bitValue = 0;
+	reader.bOverrun = false;
+
+	unsigned char* out = dest;
+	unsigned char* outEnd = dest + size;
+	*out++ = reader.readByte();
+
+	// ROM files come from anywhere, so every literal and match is bounds checked
+	while (!reader.bOverrun) {
+		if (!reader.readBit()) {
+			if (out == outEnd) {
+				return false;
+			}
+			*out++ = reader.readByte();
+			continue;
+		}
+
+		int length = reader.readEliasGamma() + 1;
+		if (length == 0) {
+			break;
+		}
+
+		int offset = reader.readByte();
+		if (offset >= ZX7_SHORT_OFFSET) {
+			int high = reader.readBit();
+			high = (high << 1) | reader.readBit();
+			high = (high << 1) | reader.readBit();
+			high = (high << 1) | reader.readBit();
+			offset = ((offset & 127) | (high << 7)) + ZX7_SHORT_OFFSET;
+		}
+		offset++;
+
+		if (offset > out - dest || length > outEnd - out) {
+			return false;
+		}
+		const unsigned char* from = out - offset;
+		while (length--) {
+			*out++ = *from++;
+		}
+	}
+
+	return !reader.bOverrun && out == outEnd;
+}
@@ -0,0 +1,6 @@
+// Bounds checked ZX7 decompression (ZX7 format by Einar Saukas), used for the compressed ROM container on every target
+#pragma once
+
+// decompresses the srcSize byte ZX7 stream at src into the size bytes at dest. Unlike the SDK ZX7Decompress the stream
+// is checked in all builds, so false if it would read or write out of bounds, or doesn't decode to exactly size bytes
+bool ZX7DecompressChecked(const unsigned char* src, unsigned int srcSize, unsigned char* dest, unsigned int size);